@@ -1,9 +1,32 @@
 #include "nsg6502.h"
+#ifndef NSG6502_FUSED
+#include "nsg6502_gdb.h"
+#endif
+#include "nsg6502_profile.h"
+#include "nsg6502_replay.h"
+#include "nsg6502_rng.h"
+#include "nsg6502_stats.h"
+#include "wozmon.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+// Output of nsg6502_recomp for the wozmon image in wozmon.h, e.g.
+// -DNSG6502_RECOMP='"wozmon_recomp.h"'
+#ifdef NSG6502_RECOMP
+#include NSG6502_RECOMP
+#endif
+
+// With NSG6502_CACHE_DIR set in the environment, wozmon is recompiled once
+// into that directory and mapped back in on later runs
+#ifndef NSG6502_NO_CACHE
+#include "nsg6502_cache.h"
+#ifndef NSG6502_CACHE_INCLUDE
+#define NSG6502_CACHE_INCLUDE "."
+#endif
+#endif
+
 void dump_hex(const void *data, size_t size) {
 	char ascii[17];
 	size_t i, j;
@@ -34,12 +57,34 @@ void dump_hex(const void *data, size_t size) {
 	}
 }
 
+static struct nsg6502_rng main_rng;
+
+// NSG6502_RECORD=<file> logs every keystroke and random byte,
+// NSG6502_REPLAY=<file> runs the session again from such a log without
+// touching the terminal
+static struct nsg6502_replay main_replay;
+static FILE *main_record;
+static int main_replaying;
+// Set once there is no more input, to NSG6502_REPLAY_DIVERGED if replay
+// went off the log or NSG6502_REPLAY_CORRUPT if the log is broken
+static int main_stop;
+
+// NSG6502_PROFILE=<file> counts opcode sequences for nsg6502_fuse
+static struct nsg6502_profile main_profile;
+
+// NSG6502_STATS=<name> publishes run statistics under that name in
+// /dev/shm for nsg6502_stats_export
+static struct nsg6502_stats main_stats;
+static int main_stats_console = -1;
+static int main_stats_random = -1;
+
 void main_memory_write_callback(struct nsg6502_cpu *c, uint16_t addr,
 								uint8_t data) {
 #ifdef NSG6502_DEBUG
 	printf("NSG6502: Writing 0x%hhx to 0x%hx\n", data, addr);
 #endif
 	if (addr == 0x200) {
+		nsg6502_stats_device_write(&main_stats, main_stats_console, 1);
 		printf("%c", data);
 		if (data == '\r') {
 			printf("\n");
@@ -52,65 +97,232 @@ uint8_t main_memory_read_callback(struct nsg6502_cpu *c, uint16_t addr) {
 #ifdef NSG6502_DEBUG
 	printf("NSG6502: Reading 0x%hx\n", addr);
 #endif
-	if (addr == 0xFE) {
-		return rand() % 256;
-	} else if (addr == 0x0202) {
-		return 1;
-	} else if (addr == 0x201) {
+	if (addr == 0xFE || addr == 0x201) {
+		nsg6502_stats_device_read(
+			&main_stats, addr == 0xFE ? main_stats_random : main_stats_console,
+			1);
 		uint8_t k = 0;
-		read(STDIN_FILENO, &k, 1);
-		if (k == '\n') {
-			return '\r';
+		if (main_replaying) {
+			int ret = nsg6502_replay_next(&main_replay, c->ticks, addr, &k);
+			if (ret != NSG6502_REPLAY_OK) {
+				main_stop = ret;
+			}
+			return k;
+		}
+		if (addr == 0xFE) {
+			k = nsg6502_rng_byte(&main_rng);
+		} else {
+			nsg6502_stats_idle_begin(&main_stats);
+			ssize_t n = read(STDIN_FILENO, &k, 1);
+			nsg6502_stats_idle_end(&main_stats);
+			if (n != 1) {
+				// The log ends here too, replay stops on the same read
+				main_stop = NSG6502_REPLAY_END;
+				return 0;
+			}
+			if (k == '\n') {
+				k = '\r';
+			}
+		}
+		if (main_record) {
+			nsg6502_replay_record(&main_replay, c->ticks, addr, k);
+			if (addr == 0x201) {
+				fflush(main_record);
+			}
 		}
 		return k;
+	} else if (addr == 0x0202) {
+		return 1;
 	} else {
 		return c->memory[addr];
 	}
 }
 
+// Installed over the plain callbacks only while statistics are published,
+// so the default bus path does not pay for counting
+void main_stats_write_callback(struct nsg6502_cpu *c, uint16_t addr,
+							   uint8_t data) {
+	nsg6502_stats_write(&main_stats);
+	main_memory_write_callback(c, addr, data);
+}
+
+uint8_t main_stats_read_callback(struct nsg6502_cpu *c, uint16_t addr) {
+	nsg6502_stats_read(&main_stats);
+	return main_memory_read_callback(c, addr);
+}
+
+// Native stand-ins for wozmon's ECHO and PRBYTE. The tick costs are what
+// the interpreted routines charge, minus the RTS that is still simulated.
+void main_trap_echo(struct nsg6502_cpu *c, void *data) {
+	main_memory_write_callback(c, 0x200, c->a);
+}
+
+void main_trap_prbyte(struct nsg6502_cpu *c, void *data) {
+	uint8_t d = c->a;
+	for (int i = 0; i < 2; i++) {
+		c->a = ((i ? d : d >> 4) & 0x0F) | 0x30;
+		if (c->a > 0x39) {
+			c->a += 7;
+			c->ticks += 2; // BCC not taken, ADC #$06
+		}
+		main_memory_write_callback(c, 0x200, c->a);
+	}
+}
+
 int main(void) {
 	struct nsg6502_cpu cpu = {0};
-	cpu.memory = malloc(0xFFFF + 1);
+	cpu.memory = calloc(0xFFFF + 1, 1);
 
 	cpu.memory_write_callback = main_memory_write_callback;
 	cpu.memory_read_callback = main_memory_read_callback;
 
-	srand(cpu.memory[0x42]);
-
-	unsigned char wozmon[] = {
-		0xd8, 0x58, 0xa9, 0x1b, 0xc9, 0x08, 0xf0, 0x13, 0xc9, 0x1b, 0xf0, 0x03,
-		0xc8, 0x10, 0x0f, 0xa9, 0x5c, 0x20, 0xe7, 0xff, 0xa9, 0x0d, 0x20, 0xe7,
-		0xff, 0xa0, 0x01, 0x88, 0x30, 0xf6, 0xad, 0x02, 0x02, 0xc9, 0x01, 0xd0,
-		0xf9, 0xad, 0x01, 0x02, 0x99, 0x00, 0x03, 0x20, 0xe7, 0xff, 0xc9, 0x0d,
-		0xd0, 0xd2, 0xa0, 0xff, 0xa9, 0x00, 0xaa, 0x0a, 0x0a, 0x85, 0x2b, 0xc8,
-		0xb9, 0x00, 0x03, 0xc9, 0x0d, 0xf0, 0xd1, 0xc9, 0x2e, 0x90, 0xf4, 0xf0,
-		0xee, 0xc9, 0x3a, 0xf0, 0xeb, 0xc9, 0x52, 0xf0, 0x3b, 0x86, 0x28, 0x86,
-		0x29, 0x84, 0x2a, 0xb9, 0x00, 0x03, 0x49, 0x30, 0xc9, 0x0a, 0x90, 0x06,
-		0x69, 0x88, 0xc9, 0xfa, 0x90, 0x11, 0x0a, 0x0a, 0x0a, 0x0a, 0xa2, 0x04,
-		0x0a, 0x26, 0x28, 0x26, 0x29, 0xca, 0xd0, 0xf8, 0xc8, 0xd0, 0xe0, 0xc4,
-		0x2a, 0xf0, 0x94, 0x24, 0x2b, 0x50, 0x10, 0xa5, 0x28, 0x81, 0x26, 0xe6,
-		0x26, 0xd0, 0xb5, 0xe6, 0x27, 0x4c, 0x3c, 0xff, 0x6c, 0x24, 0x00, 0x30,
-		0x2b, 0xa2, 0x02, 0xb5, 0x27, 0x95, 0x25, 0x95, 0x23, 0xca, 0xd0, 0xf7,
-		0xd0, 0x14, 0xa9, 0x0d, 0x20, 0xe7, 0xff, 0xa5, 0x25, 0x20, 0xd4, 0xff,
-		0xa5, 0x24, 0x20, 0xd4, 0xff, 0xa9, 0x3a, 0x20, 0xe7, 0xff, 0xa9, 0x20,
-		0x20, 0xe7, 0xff, 0xa1, 0x24, 0x20, 0xd4, 0xff, 0x86, 0x2b, 0xa5, 0x24,
-		0xc5, 0x28, 0xa5, 0x25, 0xe5, 0x29, 0xb0, 0xc1, 0xe6, 0x24, 0xd0, 0x02,
-		0xe6, 0x25, 0xa5, 0x24, 0x29, 0x07, 0x10, 0xc8, 0x48, 0x4a, 0x4a, 0x4a,
-		0x4a, 0x20, 0xdd, 0xff, 0x68, 0x29, 0x0f, 0x09, 0x30, 0xc9, 0x3a, 0x90,
-		0x02, 0x69, 0x06, 0x8d, 0x00, 0x02, 0x60};
-	unsigned int wozmon_len = 235;
+	// NSG6502_SEED=<number> picks another sequence for the random byte
+	// device, every run with the same seed sees the same bytes
+	const char *seed = getenv("NSG6502_SEED");
+	nsg6502_rng_seed(&main_rng, seed ? strtoull(seed, NULL, 0) : 6502);
 
 	// char code[] = "\xad\x01\x02\x8d\x00\x02\x4c\x00\x06";
 	memcpy(&cpu.memory[0xFF00], wozmon, wozmon_len);
 	cpu.memory[0xFFFC] = 0x00;
 	cpu.memory[0xFFFD] = 0xFF;
 
+	struct nsg6502_trap echo = {0xFFE7, 7, main_trap_echo};
+	struct nsg6502_trap prbyte = {0xFFD4, 60, main_trap_prbyte};
+	nsg6502_trap_register(&cpu, &echo);
+	nsg6502_trap_register(&cpu, &prbyte);
+
 	nsg6502_reset(&cpu);
 
-	while (cpu.pc != 0x0600 + sizeof(wozmon) - 1) {
+	const char *record = getenv("NSG6502_RECORD");
+	const char *replay = getenv("NSG6502_REPLAY");
+	if (replay) {
+		FILE *f = fopen(replay, "rb");
+		if (!f || nsg6502_replay_load(&main_replay, f) != 0) {
+			fprintf(stderr, "NSG6502: cannot replay %s\n", replay);
+			return 1;
+		}
+		fclose(f);
+		main_replaying = 1;
+	} else if (record) {
+		main_record = fopen(record, "wb");
+		if (!main_record ||
+			nsg6502_replay_record_start(&main_replay, main_record) != 0) {
+			fprintf(stderr, "NSG6502: cannot record to %s\n", record);
+			return 1;
+		}
+	}
+
+	// Before the debugger, which may wrap the callbacks
+	const char *stats = getenv("NSG6502_STATS");
+	if (stats) {
+		if (nsg6502_stats_open(&main_stats, NULL, stats) != 0) {
+			fprintf(stderr, "NSG6502: cannot publish statistics\n");
+		} else {
+			cpu.memory_read_callback = main_stats_read_callback;
+			cpu.memory_write_callback = main_stats_write_callback;
+		}
+		main_stats_console = nsg6502_stats_device(&main_stats, "console");
+		main_stats_random = nsg6502_stats_device(&main_stats, "random");
+	}
+
+	// NSG6502_GDB=<host:port or socket path> waits for a debugger there
+	// before running anything, and then runs in the interpreter
+	const char *gdb_address = getenv("NSG6502_GDB");
+#ifdef NSG6502_FUSED
+	if (gdb_address) {
+		fprintf(stderr, "NSG6502: no GDB stub in a build with fused "
+						"instructions\n");
+		return 1;
+	}
+#else
+	struct nsg6502_gdb gdb;
+	if (gdb_address) {
+		if (nsg6502_gdb_listen(&gdb, &cpu, gdb_address) != 0) {
+			fprintf(stderr, "NSG6502: cannot listen on %s\n", gdb_address);
+			return 1;
+		}
+		nsg6502_gdb_wait(&gdb);
+	}
+#endif
+
+	const char *profile = getenv("NSG6502_PROFILE");
+
+	// Instructions since the statistics were last published, only counted
+	// when interpreting
+	uint64_t instructions = 0;
+	size_t stats_due = 0;
+
+#ifndef NSG6502_NO_CACHE
+	struct nsg6502_cache cache = {0};
+	const char *cache_dir = getenv("NSG6502_CACHE_DIR");
+	uint16_t entries[] = {0xFF00};
+	if (cache_dir &&
+		nsg6502_cache_open(&cache, cache_dir, NSG6502_CACHE_INCLUDE, &cpu,
+						   0xFF00, wozmon_len, entries, 1) != 0) {
+		fprintf(stderr, "NSG6502: cache unavailable, interpreting\n");
+	}
+#endif
+
+	while (cpu.pc != 0x0600 + sizeof(wozmon) - 1 && !main_stop) {
+		if (cpu.ticks >= stats_due) {
+			nsg6502_stats_run(&main_stats, &cpu, instructions);
+			instructions = 0;
+			stats_due = cpu.ticks + 1024;
+		}
+#ifndef NSG6502_FUSED
+		if (gdb_address) {
+			if (nsg6502_gdb_run(&gdb, 1024) == NSG6502_GDB_KILLED) {
+				break;
+			}
+			continue;
+		}
+#endif
+#ifndef NSG6502_NO_CACHE
+		if (cache.run) {
+			cache.run(&cpu, 1024);
+			continue;
+		}
+#endif
+#ifdef NSG6502_RECOMP
+		nsg6502_recomp_run(&cpu, 1024);
+#else
+		if (profile) {
+			nsg6502_profile_step(&main_profile, &cpu);
+		}
 		nsg6502_opcode_execute(&cpu);
+		instructions++;
+#endif
 	}
+	nsg6502_stats_run(&main_stats, &cpu, instructions);
+	nsg6502_stats_close(&main_stats);
 
+#ifndef NSG6502_FUSED
+	if (gdb_address) {
+		nsg6502_gdb_close(&gdb);
+	}
+#endif
+	if (main_record) {
+		fclose(main_record);
+	}
+	if (profile) {
+		FILE *f = fopen(profile, "w");
+		if (!f || nsg6502_profile_save(&main_profile, f) != 0) {
+			fprintf(stderr, "NSG6502: cannot write profile %s\n", profile);
+		}
+		if (f) {
+			fclose(f);
+		}
+	}
+	nsg6502_replay_free(&main_replay);
 	free(cpu.memory);
+	if (main_stop == NSG6502_REPLAY_DIVERGED) {
+		fprintf(stderr, "NSG6502: replay diverged at tick %zu\n", cpu.ticks);
+		return 1;
+	}
+	if (main_stop == NSG6502_REPLAY_CORRUPT) {
+		fprintf(stderr, "NSG6502: corrupt replay log at tick %zu\n",
+				cpu.ticks);
+		return 1;
+	}
 	return 0;
 }
@@ -39,8 +39,17 @@
 #define NSG6502_STATUS_REGISTER_OVERFLOW (1 << 6)
 #define NSG6502_STATUS_REGISTER_NEGATIVE (1 << 7)
 
+// A 1 stored in 16 bits, big endian hosts put the 0 byte first
+static const uint16_t nsg6502_endian_probe = 1;
 #define NSG6502_IS_SYSTEM_BIG_ENDIAN \
-	(1 != *(unsigned char *)&(const uint16_t){1})
+	(1 != *(const unsigned char *)&nsg6502_endian_probe)
+
+struct nsg6502_trap;
+
+#ifdef NSG6502_65C02
+#define NSG6502_HALT_WAI 1
+#define NSG6502_HALT_STP 2
+#endif
 
 struct nsg6502_cpu {
 	uint8_t a;
@@ -51,28 +60,113 @@ struct nsg6502_cpu {
 	uint8_t sp;
 	uint8_t status;
 
+#ifdef NSG6502_LAZY_FLAGS
+	// N/Z (and C for NSG6502_LAZY_NZC) are still owed to status and have to
+	// be derived from lazy_result. Bit 8 of lazy_result is the carry.
+	uint16_t lazy_result;
+	uint8_t lazy_op;
+#endif
+
 	uint8_t *memory;
 
 	size_t ticks;
 
+	// Interrupt lines, sampled by nsg6502_opcode_execute before each
+	// instruction. irq is level triggered with one bit per device, and is
+	// taken while it is non-zero and interrupts are enabled; the device
+	// clears its bit once acknowledged. nmi is an edge, set it through
+	// nsg6502_nmi(). Recompiled code looks at them at jump targets.
+	uint8_t irq;
+	uint8_t nmi;
+
+#ifdef NSG6502_65C02
+	// NSG6502_HALT_WAI from WAI until an interrupt line is raised,
+	// NSG6502_HALT_STP from STP until reset
+	uint8_t halt;
+	// Called while the CPU waits with no interrupt pending. It should block
+	// until the host has an interrupt to deliver, raise it in irq or nmi
+	// and return; the lines are only touched from this thread that way.
+	// Without it, or if nothing was raised, nsg6502_opcode_execute charges
+	// one tick and returns.
+	void (*wait_callback)(struct nsg6502_cpu *);
+#endif
+
 	uint8_t (*memory_read_callback)(struct nsg6502_cpu *, uint16_t);
 	void (*memory_write_callback)(struct nsg6502_cpu *, uint16_t, uint8_t);
+
+	struct nsg6502_trap *traps;
 };
 
-static uint8_t nsg6502_read_byte(struct nsg6502_cpu *c, uint16_t addr) {
+// A host function standing in for the guest subroutine at addr. It runs
+// when a JSR lands on addr, with the return address already pushed, and
+// the RTS is simulated afterwards. ticks is charged instead of the cycles
+// the guest routine would have taken. status is up to date when it runs,
+// also with NSG6502_LAZY_FLAGS, and what it writes there is kept.
+struct nsg6502_trap {
+	uint16_t addr;
+	size_t ticks;
+	void (*function)(struct nsg6502_cpu *, void *);
+	void *data;
+
+	struct nsg6502_trap *next;
+};
+
+// Everything below that touches memory is a template over the CPU type
+// in C++, so nsg6502.hpp can run the same handlers on a CPU whose bus is a
+// concrete type. Its overloads of nsg6502_memory_read() and
+// nsg6502_memory_write() take over from these, which use the callbacks.
+#ifdef __cplusplus
+#define NSG6502_BUS_TEMPLATE template <class nsg6502_cpu_type>
+#define NSG6502_BUS_CPU nsg6502_cpu_type
+
+static uint8_t nsg6502_memory_read(struct nsg6502_cpu *c, uint16_t addr) {
+	return c->memory_read_callback ? c->memory_read_callback(c, addr)
+								   : c->memory[addr];
+}
+
+static void nsg6502_memory_write(struct nsg6502_cpu *c, uint16_t addr,
+								 uint8_t data) {
+	if (c->memory_write_callback) {
+		c->memory_write_callback(c, addr, data);
+	} else {
+		c->memory[addr] = data;
+	}
+}
+#else
+#define NSG6502_BUS_TEMPLATE
+#define NSG6502_BUS_CPU struct nsg6502_cpu
+#endif
+
+// In C the callbacks are tested right here, one more call to inline keeps
+// GCC from inlining nsg6502_fetch_word
+NSG6502_BUS_TEMPLATE
+static uint8_t nsg6502_read_byte(NSG6502_BUS_CPU *c, uint16_t addr) {
 	c->ticks++;
+#ifdef __cplusplus
+	return nsg6502_memory_read(c, addr);
+#else
 	return c->memory_read_callback ? c->memory_read_callback(c, addr)
 								   : c->memory[addr];
+#endif
 }
 
-static void nsg6502_write_byte(struct nsg6502_cpu *c, uint16_t addr,
+NSG6502_BUS_TEMPLATE
+static void nsg6502_write_byte(NSG6502_BUS_CPU *c, uint16_t addr,
 							   uint8_t data) {
 	c->ticks++;
-	c->memory_write_callback ? c->memory_write_callback(c, addr, data)
-							 : (c->memory[addr] = data);
+#ifdef __cplusplus
+	nsg6502_memory_write(c, addr, data);
+#else
+	if (c->memory_write_callback) {
+		c->memory_write_callback(c, addr, data);
+	} else {
+		c->memory[addr] = data;
+	}
+#endif
 }
 
-static uint16_t nsg6502_read_word(struct nsg6502_cpu *c, uint16_t addr) {
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_read_word(NSG6502_BUS_CPU *c, uint16_t addr) {
 	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
 		return (nsg6502_read_byte(c, addr) << 8) |
 			   (nsg6502_read_byte(c, addr + 1));
@@ -82,7 +176,8 @@ static uint16_t nsg6502_read_word(struct nsg6502_cpu *c, uint16_t addr) {
 	}
 }
 
-static void nsg6502_write_word(struct nsg6502_cpu *c, uint16_t addr,
+NSG6502_BUS_TEMPLATE
+static void nsg6502_write_word(NSG6502_BUS_CPU *c, uint16_t addr,
 							   uint16_t data) {
 	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
 		nsg6502_write_byte(c, addr, (data >> 8) & 0xFF);
@@ -93,27 +188,134 @@ static void nsg6502_write_word(struct nsg6502_cpu *c, uint16_t addr,
 	}
 }
 
-static uint8_t nsg6502_fetch_byte(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static uint8_t nsg6502_fetch_byte(NSG6502_BUS_CPU *c) {
 	return nsg6502_read_byte(c, c->pc++);
 }
 
-static uint16_t nsg6502_fetch_word(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_fetch_word(NSG6502_BUS_CPU *c) {
 	uint16_t ret = nsg6502_read_word(c, c->pc++);
 	c->pc++;
 	return ret;
 }
 
-static uint8_t nsg6502_stack_pop_byte(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static uint8_t nsg6502_stack_pop_byte(NSG6502_BUS_CPU *c) {
 	c->sp++;
 	return nsg6502_read_byte(c, c->sp + 0x100);
 }
 
-static void nsg6502_stack_push_byte(struct nsg6502_cpu *c, uint8_t d) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_stack_push_byte(NSG6502_BUS_CPU *c, uint8_t d) {
 	nsg6502_write_byte(c, c->sp + 0x100, d);
 	c->sp--;
 }
 
+#define NSG6502_LAZY_NONE 0
+#define NSG6502_LAZY_NZ 1
+#define NSG6502_LAZY_NZC 2
+
+// Brings status up to date. Has to be called before the host looks at
+// status when NSG6502_LAZY_FLAGS is set, it does nothing otherwise.
+static void nsg6502_flags_resolve(struct nsg6502_cpu *c) {
+#ifdef NSG6502_LAZY_FLAGS
+	if (c->lazy_op == NSG6502_LAZY_NONE) {
+		return;
+	}
+
+	uint8_t res = c->lazy_result & 0xFF;
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_ZERO |
+									  NSG6502_STATUS_REGISTER_NEGATIVE);
+	if ((res & 0x80)) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_NEGATIVE);
+	}
+	if (res == 0) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_ZERO);
+	}
+
+	if (c->lazy_op == NSG6502_LAZY_NZC) {
+		NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
+		if (c->lazy_result & 0x100) {
+			NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
+		}
+	}
+
+	c->lazy_op = NSG6502_LAZY_NONE;
+#endif
+}
+
+// Reads a single N/Z/C bit straight from the pending result, so branches do
+// not have to materialize the whole register
+static uint8_t nsg6502_flag_test(struct nsg6502_cpu *c, uint8_t flag) {
+#ifdef NSG6502_LAZY_FLAGS
+	if (c->lazy_op != NSG6502_LAZY_NONE) {
+		switch (flag) {
+			case NSG6502_STATUS_REGISTER_ZERO:
+				return (c->lazy_result & 0xFF) == 0;
+			case NSG6502_STATUS_REGISTER_NEGATIVE:
+				return (c->lazy_result & 0x80) != 0;
+			case NSG6502_STATUS_REGISTER_CARRY:
+				if (c->lazy_op == NSG6502_LAZY_NZC) {
+					return (c->lazy_result & 0x100) != 0;
+				}
+				break;
+		}
+	}
+#endif
+	return NSG6502_FLAG_IS_SET(c->status, flag);
+}
+
+#ifdef NSG6502_TABLE_ALU
+// N and Z bits for every possible result byte
+static uint8_t nsg6502_nz_table[256];
+#endif
+
+// The trap is owned by the caller and has to stay alive while registered
+static void nsg6502_trap_register(struct nsg6502_cpu *c,
+								  struct nsg6502_trap *t) {
+	t->next = c->traps;
+	c->traps = t;
+}
+
+static void nsg6502_trap_unregister(struct nsg6502_cpu *c,
+									struct nsg6502_trap *t) {
+	for (struct nsg6502_trap **p = &c->traps; *p; p = &(*p)->next) {
+		if (*p == t) {
+			*p = t->next;
+			return;
+		}
+	}
+}
+
+static struct nsg6502_trap *nsg6502_trap_find(struct nsg6502_cpu *c,
+											  uint16_t addr) {
+	for (struct nsg6502_trap *t = c->traps; t; t = t->next) {
+		if (t->addr == addr) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
 static void nsg6502_evaluate_flags(struct nsg6502_cpu *c, uint8_t res) {
+#ifdef NSG6502_LAZY_FLAGS
+	// A pending compare still owns the carry, settle it before its result is
+	// replaced
+	if (c->lazy_op == NSG6502_LAZY_NZC) {
+		c->status = (c->status & ~NSG6502_STATUS_REGISTER_CARRY) |
+					((c->lazy_result >> 8) & 1);
+	}
+	c->lazy_result = res;
+	c->lazy_op = NSG6502_LAZY_NZ;
+	return;
+#endif
+#ifdef NSG6502_TABLE_ALU
+	c->status = (c->status & ~(NSG6502_STATUS_REGISTER_ZERO |
+							   NSG6502_STATUS_REGISTER_NEGATIVE)) |
+				nsg6502_nz_table[res];
+	return;
+#endif
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_ZERO);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_NEGATIVE);
 
@@ -125,9 +327,20 @@ static void nsg6502_evaluate_flags(struct nsg6502_cpu *c, uint8_t res) {
 	}
 }
 
-static void nsg6502_reset(struct nsg6502_cpu *c) {
+#ifdef NSG6502_TABLE_ALU
+static void nsg6502_alu_init(void);
+#endif
+
+NSG6502_BUS_TEMPLATE
+static void nsg6502_reset(NSG6502_BUS_CPU *c) {
+#ifdef NSG6502_TABLE_ALU
+	nsg6502_alu_init();
+#endif
 	c->pc = nsg6502_read_word(c, 0xFFFC);
 	c->sp = 0x00FD; // the SP will be 0x01FD
+#ifdef NSG6502_65C02
+	c->halt = 0;
+#endif
 	NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_INTERRUPT_DISABLE);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_DECIMAL);
 #ifdef NSG6502_DEBUG
@@ -137,7 +350,7 @@ static void nsg6502_reset(struct nsg6502_cpu *c) {
 #endif
 }
 
-static void nsg6502_adc(struct nsg6502_cpu *c, uint8_t d) {
+static void nsg6502_adc_compute(struct nsg6502_cpu *c, uint8_t d) {
 	int32_t tmp =
 		c->a + d +
 		(NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
@@ -181,7 +394,7 @@ static void nsg6502_adc(struct nsg6502_cpu *c, uint8_t d) {
 	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_sbc(struct nsg6502_cpu *c, uint8_t d) {
+static void nsg6502_sbc_compute(struct nsg6502_cpu *c, uint8_t d) {
 	int32_t tmp =
 		c->a - d -
 		(NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0 : 1);
@@ -218,8 +431,113 @@ static void nsg6502_sbc(struct nsg6502_cpu *c, uint8_t d) {
 	nsg6502_evaluate_flags(c, c->a);
 }
 
+#define NSG6502_ALU_FLAGS                                                      \
+	(NSG6502_STATUS_REGISTER_CARRY | NSG6502_STATUS_REGISTER_ZERO |            \
+	 NSG6502_STATUS_REGISTER_OVERFLOW | NSG6502_STATUS_REGISTER_NEGATIVE)
+
+#ifdef NSG6502_TABLE_ALU
+// ADC/SBC results are looked up instead of computed. Each entry holds the
+// result in the high byte and the N/Z/C/V bits in the low byte, indexed by
+// (D << 17) | (C << 16) | (A << 8) | operand. The tables are filled from
+// nsg6502_adc_compute/nsg6502_sbc_compute so both paths agree bit for bit.
+static uint16_t nsg6502_adc_table[1 << 18];
+static uint16_t nsg6502_sbc_table[1 << 18];
+// 0 until the first caller claims the fill, 1 while it runs, 2 once the
+// tables are complete. GCC atomic builtins rather than stdatomic.h so the
+// header stays usable without libc and from C++.
+static int nsg6502_alu_state;
+
+static size_t nsg6502_alu_index(uint8_t status, uint8_t a, uint8_t d) {
+	return ((size_t)(status & NSG6502_STATUS_REGISTER_DECIMAL) << 14) |
+		   ((size_t)(status & NSG6502_STATUS_REGISTER_CARRY) << 16) |
+		   ((size_t)a << 8) | d;
+}
+
+// Fills the tables once. A thread that loses the race to fill them waits
+// for the winner, so no thread can look at a table before it is complete.
+static void nsg6502_alu_init(void) {
+	if (__atomic_load_n(&nsg6502_alu_state, __ATOMIC_ACQUIRE) == 2) {
+		return;
+	}
+	int expected = 0;
+	if (!__atomic_compare_exchange_n(&nsg6502_alu_state, &expected, 1, 0,
+									 __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&nsg6502_alu_state, __ATOMIC_ACQUIRE) != 2) {
+		}
+		return;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		nsg6502_nz_table[i] =
+			(i & 0x80 ? NSG6502_STATUS_REGISTER_NEGATIVE : 0) |
+			(i == 0 ? NSG6502_STATUS_REGISTER_ZERO : 0);
+	}
+
+	// Zeroed, and only the thread filling the tables gets here
+	static struct nsg6502_cpu t;
+	for (size_t i = 0; i < (1 << 18); i++) {
+		uint8_t status = ((i >> 16) & 1 ? NSG6502_STATUS_REGISTER_CARRY : 0) |
+						 ((i >> 17) & 1 ? NSG6502_STATUS_REGISTER_DECIMAL : 0);
+		uint8_t a = (i >> 8) & 0xFF;
+		uint8_t d = i & 0xFF;
+
+		t.a = a;
+		t.status = status;
+		nsg6502_adc_compute(&t, d);
+		nsg6502_flags_resolve(&t);
+		nsg6502_adc_table[i] = (t.a << 8) | (t.status & NSG6502_ALU_FLAGS);
+
+		t.a = a;
+		t.status = status;
+		nsg6502_sbc_compute(&t, d);
+		nsg6502_flags_resolve(&t);
+		nsg6502_sbc_table[i] = (t.a << 8) | (t.status & NSG6502_ALU_FLAGS);
+	}
+
+	__atomic_store_n(&nsg6502_alu_state, 2, __ATOMIC_RELEASE);
+}
+
+static void nsg6502_alu_apply(struct nsg6502_cpu *c, const uint16_t *table,
+							  uint8_t d) {
+	uint16_t r = table[nsg6502_alu_index(c->status, c->a, d)];
+	c->a = r >> 8;
+	c->status = (c->status & ~NSG6502_ALU_FLAGS) | (r & 0xFF);
+}
+#endif
+
+static void nsg6502_adc(struct nsg6502_cpu *c, uint8_t d) {
+#ifdef NSG6502_TABLE_ALU
+	nsg6502_alu_apply(c, nsg6502_adc_table, d);
+#else
+	nsg6502_adc_compute(c, d);
+#endif
+}
+
+static void nsg6502_sbc(struct nsg6502_cpu *c, uint8_t d) {
+#ifdef NSG6502_TABLE_ALU
+	nsg6502_alu_apply(c, nsg6502_sbc_table, d);
+#else
+	nsg6502_sbc_compute(c, d);
+#endif
+}
+
+// CMP, CPX and CPY: N/Z from reg - d, carry set when no borrow happened
+static void nsg6502_compare(struct nsg6502_cpu *c, uint8_t reg, uint8_t d) {
+#ifdef NSG6502_LAZY_FLAGS
+	c->lazy_result = reg + (d ^ 0xFF) + 1;
+	c->lazy_op = NSG6502_LAZY_NZC;
+#else
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
+	int32_t tmp = reg - d;
+	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
+	if (tmp >= 0) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
+	}
+#endif
+}
+
 struct nsg6502_opcode {
-	char *name;
+	const char *name;
 	size_t ticks;
 	void (*function)(struct nsg6502_cpu *);
 };
@@ -244,38 +562,6 @@ static void nsg6502_opcode_clv(struct nsg6502_cpu *c) {
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_OVERFLOW);
 }
 
-static void nsg6502_opcode_dec_zp(struct nsg6502_cpu *c) {
-	uint8_t addr = nsg6502_fetch_byte(c);
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) - 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_dec_zpx(struct nsg6502_cpu *c) {
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) - 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_dec_abs(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c);
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) - 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_dec_abx(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) - 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
 static void nsg6502_opcode_dex(struct nsg6502_cpu *c) {
 	c->x--;
 	nsg6502_evaluate_flags(c, c->x);
@@ -286,38 +572,6 @@ static void nsg6502_opcode_dey(struct nsg6502_cpu *c) {
 	nsg6502_evaluate_flags(c, c->y);
 }
 
-static void nsg6502_opcode_inc_zp(struct nsg6502_cpu *c) {
-	uint8_t addr = nsg6502_fetch_byte(c);
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) + 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_inc_zpx(struct nsg6502_cpu *c) {
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) + 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_inc_abs(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c);
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) + 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_inc_absx(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	nsg6502_write_byte(c, addr, nsg6502_read_byte(c, addr) + 1);
-
-	uint8_t d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
 static void nsg6502_opcode_inx(struct nsg6502_cpu *c) {
 	c->x++;
 	nsg6502_evaluate_flags(c, c->x);
@@ -328,98 +582,6 @@ static void nsg6502_opcode_iny(struct nsg6502_cpu *c) {
 	nsg6502_evaluate_flags(c, c->y);
 }
 
-static void nsg6502_opcode_lda_imm(struct nsg6502_cpu *c) {
-	c->a = nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_zp(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_zpx(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_abs(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_abx(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_aby(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_inx(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									c->x);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lda_iny(struct nsg6502_cpu *c) {
-	c->a = nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									c->y);
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_ldx_imm(struct nsg6502_cpu *c) {
-	c->x = nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->x);
-}
-
-static void nsg6502_opcode_ldx_zp(struct nsg6502_cpu *c) {
-	c->x = nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->x);
-}
-
-static void nsg6502_opcode_ldx_zpy(struct nsg6502_cpu *c) {
-	c->x = nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->y) & 0xFF);
-	nsg6502_evaluate_flags(c, c->x);
-}
-
-static void nsg6502_opcode_ldx_abs(struct nsg6502_cpu *c) {
-	c->x = nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, c->x);
-}
-
-static void nsg6502_opcode_ldx_aby(struct nsg6502_cpu *c) {
-	c->x = nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, c->x);
-}
-
-static void nsg6502_opcode_ldy_imm(struct nsg6502_cpu *c) {
-	c->y = nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->y);
-}
-
-static void nsg6502_opcode_ldy_zp(struct nsg6502_cpu *c) {
-	c->y = nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->y);
-}
-
-static void nsg6502_opcode_ldy_zpx(struct nsg6502_cpu *c) {
-	c->y = nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, c->y);
-}
-
-static void nsg6502_opcode_ldy_abs(struct nsg6502_cpu *c) {
-	c->y = nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, c->y);
-}
-
-static void nsg6502_opcode_ldy_abx(struct nsg6502_cpu *c) {
-	c->y = nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, c->y);
-}
-
 static void nsg6502_opcode_sec(struct nsg6502_cpu *c) {
 	NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
 }
@@ -432,63 +594,6 @@ static void nsg6502_opcode_sei(struct nsg6502_cpu *c) {
 	NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_INTERRUPT_DISABLE);
 }
 
-static void nsg6502_opcode_sta_zp(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_byte(c), c->a);
-}
-
-static void nsg6502_opcode_sta_zpx(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF, c->a);
-}
-
-static void nsg6502_opcode_sta_abs(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_word(c), c->a);
-}
-
-static void nsg6502_opcode_sta_abx(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_word(c) + c->x, c->a);
-}
-
-static void nsg6502_opcode_sta_aby(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_word(c) + c->y, c->a);
-}
-
-static void nsg6502_opcode_sta_inx(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(
-		c, nsg6502_read_word(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF), c->a);
-}
-
-static void nsg6502_opcode_sta_iny(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(
-		c,
-		nsg6502_read_byte(
-			c, nsg6502_read_word(c, (nsg6502_fetch_byte(c) + c->y) & 0xFF)),
-		c->a);
-}
-
-static void nsg6502_opcode_stx_zp(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_byte(c), c->x);
-}
-
-static void nsg6502_opcode_stx_zpy(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, (nsg6502_fetch_byte(c) + c->y) & 0xFF, c->x);
-}
-
-static void nsg6502_opcode_stx_abs(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_word(c), c->x);
-}
-
-static void nsg6502_opcode_sty_zp(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_byte(c), c->y);
-}
-
-static void nsg6502_opcode_sty_zpx(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF, c->y);
-}
-
-static void nsg6502_opcode_sty_abs(struct nsg6502_cpu *c) {
-	nsg6502_write_byte(c, nsg6502_fetch_word(c), c->y);
-}
-
 static void nsg6502_opcode_tax(struct nsg6502_cpu *c) {
 	c->x = c->a;
 	nsg6502_evaluate_flags(c, c->x);
@@ -519,702 +624,325 @@ static void nsg6502_opcode_txs(struct nsg6502_cpu *c) {
 	nsg6502_evaluate_flags(c, c->sp);
 }
 
-static void nsg6502_opcode_pha(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_pha(NSG6502_BUS_CPU *c) {
 	nsg6502_stack_push_byte(c, c->a);
 }
 
-static void nsg6502_opcode_pla(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_pla(NSG6502_BUS_CPU *c) {
 	c->a = nsg6502_stack_pop_byte(c);
 	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_opcode_php(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_php(NSG6502_BUS_CPU *c) {
 	uint8_t d = c->status;
 	d |= 0x20;
 	d &= (~ NSG6502_STATUS_REGISTER_BREAK);
 	nsg6502_stack_push_byte(c, d);
 }
 
-static void nsg6502_opcode_plp(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_plp(NSG6502_BUS_CPU *c) {
 	uint8_t d = nsg6502_stack_pop_byte(c);
 	d &= ~(0x20 | NSG6502_STATUS_REGISTER_BREAK);
 	c->status = d;
 }
 
-static void nsg6502_opcode_ora_imm(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->a);
+#ifdef NSG6502_65C02
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_phx(NSG6502_BUS_CPU *c) {
+	nsg6502_stack_push_byte(c, c->x);
 }
 
-static void nsg6502_opcode_ora_zp(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_plx(NSG6502_BUS_CPU *c) {
+	c->x = nsg6502_stack_pop_byte(c);
+	nsg6502_evaluate_flags(c, c->x);
 }
 
-static void nsg6502_opcode_ora_zpx(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_phy(NSG6502_BUS_CPU *c) {
+	nsg6502_stack_push_byte(c, c->y);
 }
 
-static void nsg6502_opcode_ora_abs(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_ply(NSG6502_BUS_CPU *c) {
+	c->y = nsg6502_stack_pop_byte(c);
+	nsg6502_evaluate_flags(c, c->y);
 }
 
-static void nsg6502_opcode_ora_abx(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, c->a);
+static void nsg6502_opcode_wai(struct nsg6502_cpu *c) {
+	c->halt = NSG6502_HALT_WAI;
 }
 
-static void nsg6502_opcode_ora_aby(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, c->a);
+static void nsg6502_opcode_stp(struct nsg6502_cpu *c) {
+	c->halt = NSG6502_HALT_STP;
 }
+#endif
 
-static void nsg6502_opcode_ora_inx(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->x);
-	nsg6502_evaluate_flags(c, c->a);
+// Addressing modes. Each fetches the operand bytes and returns the
+// effective address; zero page indexing and pointers wrap within page 0.
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_zp(NSG6502_BUS_CPU *c) {
+	return nsg6502_fetch_byte(c);
 }
 
-static void nsg6502_opcode_ora_iny(struct nsg6502_cpu *c) {
-	c->a |= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->y);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_zpx(NSG6502_BUS_CPU *c) {
+	return (nsg6502_fetch_byte(c) + c->x) & 0xFF;
 }
 
-static void nsg6502_opcode_and_imm(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_zpy(NSG6502_BUS_CPU *c) {
+	return (nsg6502_fetch_byte(c) + c->y) & 0xFF;
 }
 
-static void nsg6502_opcode_and_zp(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_abs(NSG6502_BUS_CPU *c) {
+	return nsg6502_fetch_word(c);
 }
 
-static void nsg6502_opcode_and_zpx(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_abx(NSG6502_BUS_CPU *c) {
+	return nsg6502_fetch_word(c) + c->x;
 }
 
-static void nsg6502_opcode_and_abs(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_aby(NSG6502_BUS_CPU *c) {
+	return nsg6502_fetch_word(c) + c->y;
 }
 
-static void nsg6502_opcode_and_abx(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_read_zp_word(NSG6502_BUS_CPU *c, uint8_t ptr) {
+	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
+		return (nsg6502_read_byte(c, ptr) << 8) |
+			   nsg6502_read_byte(c, (uint8_t)(ptr + 1));
+	} else {
+		return nsg6502_read_byte(c, ptr) |
+			   (nsg6502_read_byte(c, (uint8_t)(ptr + 1)) << 8);
+	}
 }
 
-static void nsg6502_opcode_and_aby(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_inx(NSG6502_BUS_CPU *c) {
+	return nsg6502_read_zp_word(c, nsg6502_fetch_byte(c) + c->x);
 }
 
-static void nsg6502_opcode_and_inx(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->x);
-	nsg6502_evaluate_flags(c, c->a);
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_iny(NSG6502_BUS_CPU *c) {
+	return nsg6502_read_zp_word(c, nsg6502_fetch_byte(c)) + c->y;
 }
 
-static void nsg6502_opcode_and_iny(struct nsg6502_cpu *c) {
-	c->a &= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->y);
-	nsg6502_evaluate_flags(c, c->a);
+#ifdef NSG6502_65C02
+NSG6502_BUS_TEMPLATE
+static uint16_t nsg6502_addr_zpi(NSG6502_BUS_CPU *c) {
+	return nsg6502_read_zp_word(c, nsg6502_fetch_byte(c));
 }
+#endif
 
-static void nsg6502_opcode_eor_imm(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, c->a);
+// The operand value of an instruction in each addressing mode
+NSG6502_BUS_TEMPLATE
+static uint8_t nsg6502_operand_imm(NSG6502_BUS_CPU *c) {
+	return nsg6502_fetch_byte(c);
 }
 
-static void nsg6502_opcode_eor_zp(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, c->a);
-}
+#define NSG6502_OPERAND(mode)                                                  \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static uint8_t nsg6502_operand_##mode(NSG6502_BUS_CPU *c) {                \
+		return nsg6502_read_byte(c, nsg6502_addr_##mode(c));                   \
+	}
 
-static void nsg6502_opcode_eor_zpx(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, c->a);
-}
+NSG6502_OPERAND(zp)
+NSG6502_OPERAND(zpx)
+NSG6502_OPERAND(zpy)
+NSG6502_OPERAND(abs)
+NSG6502_OPERAND(abx)
+NSG6502_OPERAND(aby)
+NSG6502_OPERAND(inx)
+NSG6502_OPERAND(iny)
+#ifdef NSG6502_65C02
+NSG6502_OPERAND(zpi)
+#endif
 
-static void nsg6502_opcode_eor_abs(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_fetch_word(c));
+// Operations taking an operand value. nsg6502_adc and nsg6502_sbc are
+// above.
+static void nsg6502_lda(struct nsg6502_cpu *c, uint8_t d) {
+	c->a = d;
 	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_opcode_eor_abx(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, c->a);
+static void nsg6502_ldx(struct nsg6502_cpu *c, uint8_t d) {
+	c->x = d;
+	nsg6502_evaluate_flags(c, c->x);
 }
 
-static void nsg6502_opcode_eor_aby(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, c->a);
+static void nsg6502_ldy(struct nsg6502_cpu *c, uint8_t d) {
+	c->y = d;
+	nsg6502_evaluate_flags(c, c->y);
 }
 
-static void nsg6502_opcode_eor_inx(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->x);
+static void nsg6502_ora(struct nsg6502_cpu *c, uint8_t d) {
+	c->a |= d;
 	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_opcode_eor_iny(struct nsg6502_cpu *c) {
-	c->a ^= nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) +
-									 c->y);
+static void nsg6502_and(struct nsg6502_cpu *c, uint8_t d) {
+	c->a &= d;
 	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_opcode_adc_imm(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_fetch_byte(c));
+static void nsg6502_eor(struct nsg6502_cpu *c, uint8_t d) {
+	c->a ^= d;
+	nsg6502_evaluate_flags(c, c->a);
 }
 
-static void nsg6502_opcode_adc_zp(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_read_byte(c, nsg6502_fetch_byte(c)));
+static void nsg6502_cmp(struct nsg6502_cpu *c, uint8_t d) {
+	nsg6502_compare(c, c->a, d);
 }
 
-static void nsg6502_opcode_adc_zpx(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_read_byte(c, (nsg6502_fetch_byte(c)) + c->x) & 0xFF);
+static void nsg6502_cpx(struct nsg6502_cpu *c, uint8_t d) {
+	nsg6502_compare(c, c->x, d);
 }
 
-static void nsg6502_opcode_adc_abs(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c)));
+static void nsg6502_cpy(struct nsg6502_cpu *c, uint8_t d) {
+	nsg6502_compare(c, c->y, d);
 }
 
-static void nsg6502_opcode_adc_abx(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x));
+static void nsg6502_bit(struct nsg6502_cpu *c, uint8_t d) {
+	uint16_t tmp = c->a & d;
+	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
+	if (tmp & 0x40) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_OVERFLOW);
+	}
 }
 
-static void nsg6502_opcode_adc_aby(struct nsg6502_cpu *c) {
-	nsg6502_adc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y));
-}
+// The value an instruction stores
+static uint8_t nsg6502_sta(struct nsg6502_cpu *c) { return c->a; }
 
-static void nsg6502_opcode_adc_inx(struct nsg6502_cpu *c) {
-	nsg6502_adc(
-		c, nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c))) +
-			   c->x);
-}
+static uint8_t nsg6502_stx(struct nsg6502_cpu *c) { return c->x; }
 
-static void nsg6502_opcode_adc_iny(struct nsg6502_cpu *c) {
-	nsg6502_adc(
-		c, nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c))) +
-			   c->y);
-}
+static uint8_t nsg6502_sty(struct nsg6502_cpu *c) { return c->y; }
 
-static void nsg6502_opcode_sbc_imm(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_fetch_byte(c));
+// Read-modify-write operations. They return the new value, N/Z is set from
+// it by the handler.
+static uint8_t nsg6502_asl(struct nsg6502_cpu *c, uint8_t d) {
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
+	if (d & 0x80) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
+	}
+	return d << 1;
 }
 
-static void nsg6502_opcode_sbc_zp(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_read_byte(c, nsg6502_fetch_byte(c)));
-}
-
-static void nsg6502_opcode_sbc_zpx(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_read_byte(c, (nsg6502_fetch_byte(c)) + c->x) & 0xFF);
-}
-
-static void nsg6502_opcode_sbc_abs(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c)));
-}
-
-static void nsg6502_opcode_sbc_abx(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x));
-}
-
-static void nsg6502_opcode_sbc_aby(struct nsg6502_cpu *c) {
-	nsg6502_sbc(c, nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y));
-}
-
-static void nsg6502_opcode_sbc_inx(struct nsg6502_cpu *c) {
-	nsg6502_sbc(
-		c, nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c))) +
-			   c->x);
-}
-
-static void nsg6502_opcode_sbc_iny(struct nsg6502_cpu *c) {
-	nsg6502_sbc(
-		c, nsg6502_read_byte(c, nsg6502_read_word(c, nsg6502_fetch_byte(c))) +
-			   c->y);
-}
-
-static void nsg6502_opcode_cmp_imm(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->a - nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_zp(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->a - nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_zpx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp =
-		c->a - nsg6502_read_byte(c, (nsg6502_fetch_byte(c) + c->x) & 0xFF);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_abs(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->a - nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_abx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->a - nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->x);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_aby(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->a - nsg6502_read_byte(c, nsg6502_fetch_word(c) + c->y);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_inx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp =
-		c->a - nsg6502_read_byte(
-				   c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) + c->x);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cmp_iny(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp =
-		c->a - nsg6502_read_byte(
-				   c, nsg6502_read_word(c, nsg6502_fetch_byte(c)) + c->y);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpy_imm(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->y - nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpy_zp(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->y - nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpy_abs(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->y - nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpx_imm(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->x - nsg6502_fetch_byte(c);
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpx_zp(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->x - nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_cpx_abs(struct nsg6502_cpu *c) {
+static uint8_t nsg6502_lsr(struct nsg6502_cpu *c, uint8_t d) {
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	int32_t tmp = c->x - nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp >= 0) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_bit_zp(struct nsg6502_cpu *c) {
-	uint16_t tmp = c->a & nsg6502_read_byte(c, nsg6502_fetch_byte(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp & 0x40) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_OVERFLOW);
-	}
-}
-
-static void nsg6502_opcode_bit_abs(struct nsg6502_cpu *c) {
-	uint16_t tmp = c->a & nsg6502_read_byte(c, nsg6502_fetch_word(c));
-	nsg6502_evaluate_flags(c, (uint8_t)(tmp & 0xFF));
-	if (tmp & 0x40) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_OVERFLOW);
-	}
-}
-
-static void nsg6502_opcode_asl_a(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (c->a & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	c->a = c->a << 1;
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_asl_zp(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint8_t addr = nsg6502_fetch_byte(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
-	if (d & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_write_byte(c, addr, d << 1);
-	d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_asl_zpx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	nsg6502_write_byte(c, addr, d << 1);
-	d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
-	if (d & 0xFF00) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-}
-
-static void nsg6502_opcode_asl_abs(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint16_t addr = nsg6502_fetch_word(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
-
-	if (d & 0x80) {
+	if (d & 0x01) {
 		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
 	}
-
-	nsg6502_write_byte(c, addr, d << 1);
-
-	d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
+	return d >> 1;
 }
 
-static void nsg6502_opcode_asl_abx(struct nsg6502_cpu *c) {
+static uint8_t nsg6502_rol(struct nsg6502_cpu *c, uint8_t d) {
+	uint8_t res =
+		(d << 1) |
+		(NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	uint8_t d = nsg6502_read_byte(c, addr);
 	if (d & 0x80) {
 		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
 	}
-	nsg6502_write_byte(c, addr, d << 1);
-
-	d = c->memory[addr];
-	nsg6502_evaluate_flags(c, d);
+	return res;
 }
 
-static void nsg6502_opcode_lsr_a(struct nsg6502_cpu *c) {
+static uint8_t nsg6502_ror(struct nsg6502_cpu *c, uint8_t d) {
+	uint8_t res =
+		(d >> 1) |
+		(NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80
+																		: 0);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (c->a & 0x01) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	c->a = c->a >> 1;
-	c->a &= 0x7f;
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_lsr_zp(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint8_t addr = nsg6502_fetch_byte(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
 	if (d & 0x01) {
 		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
 	}
-	d >>= 1;
-	d &= 0x7f;
-	nsg6502_write_byte(c, addr, d);
-	nsg6502_evaluate_flags(c, d);
+	return res;
 }
 
-static void nsg6502_opcode_lsr_zpx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	if (d & 0x01) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	d >>= 1;
-	d &= 0x7f;
-	nsg6502_write_byte(c, addr, d);
-	nsg6502_evaluate_flags(c, d);
-}
+static uint8_t nsg6502_inc(struct nsg6502_cpu *c, uint8_t d) { return d + 1; }
 
-static void nsg6502_opcode_lsr_abs(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint16_t addr = nsg6502_fetch_word(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
+static uint8_t nsg6502_dec(struct nsg6502_cpu *c, uint8_t d) { return d - 1; }
 
-	if (d & 0x01) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	d >>= 1;
-	d &= 0x7f;
-	nsg6502_write_byte(c, addr, d);
-	nsg6502_evaluate_flags(c, d);
+// Branch conditions
+static int nsg6502_cond_bpl(struct nsg6502_cpu *c) {
+	return !nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_NEGATIVE);
 }
 
-static void nsg6502_opcode_lsr_abx(struct nsg6502_cpu *c) {
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	if (d & 0x01) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	d >>= 1;
-	d &= 0x7f;
-	nsg6502_write_byte(c, addr, d);
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_bmi(struct nsg6502_cpu *c) {
+	return nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_NEGATIVE);
 }
 
-static void nsg6502_opcode_rol_a(struct nsg6502_cpu *c) {
-	uint8_t d = c->a << 1;
-	d &= 0xfe;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (c->a & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-
-	c->a = d;
-
-	nsg6502_evaluate_flags(c, c->a);
+static int nsg6502_cond_bvc(struct nsg6502_cpu *c) {
+	return !nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_OVERFLOW);
 }
 
-static void nsg6502_opcode_rol_zp(struct nsg6502_cpu *c) {
-	uint8_t addr = nsg6502_fetch_byte(c);
-	uint8_t d = nsg6502_read_byte(c, addr) ;
-	uint8_t orig = d;
-	
-	d <<= 1;
-	d &= 0xfe;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_bvs(struct nsg6502_cpu *c) {
+	return nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_OVERFLOW);
 }
 
-static void nsg6502_opcode_rol_zpx(struct nsg6502_cpu *c) {
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d <<= 1;
-	d &= 0xfe;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_bcc(struct nsg6502_cpu *c) {
+	return !nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_CARRY);
 }
 
-static void nsg6502_opcode_rol_abs(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d <<= 1;
-	d &= 0xfe;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_bcs(struct nsg6502_cpu *c) {
+	return nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_CARRY);
 }
 
-static void nsg6502_opcode_rol_abx(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d <<= 1;
-	d &= 0xfe;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 1 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x80) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_bne(struct nsg6502_cpu *c) {
+	return !nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_ZERO);
 }
 
-static void nsg6502_opcode_ror_a(struct nsg6502_cpu *c) {
-	uint8_t d = c->a >> 1;
-	d &= 0x7f;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80 : 0);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (c->a & 0x1) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-
-	c->a = d;	
-
-	nsg6502_evaluate_flags(c, c->a);
-}
-
-static void nsg6502_opcode_ror_zp(struct nsg6502_cpu *c) {
-	uint8_t addr = nsg6502_fetch_byte(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d >>= 1;
-	d &= 0x7f;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x1) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
+static int nsg6502_cond_beq(struct nsg6502_cpu *c) {
+	return nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_ZERO);
 }
 
-static void nsg6502_opcode_ror_zpx(struct nsg6502_cpu *c) {
-	uint8_t addr = (nsg6502_fetch_byte(c) + c->x) & 0xFF;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d >>= 1;
-	d &= 0x7f;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80 : 0);
+#ifdef NSG6502_65C02
+static int nsg6502_cond_bra(struct nsg6502_cpu *c) { return 1; }
 
-	nsg6502_write_byte(
-		c, addr,
-		d);
+static uint8_t nsg6502_stz(struct nsg6502_cpu *c) { return 0; }
 
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x1) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	}
-	nsg6502_evaluate_flags(c, d);
-}
-
-static void nsg6502_opcode_ror_abs(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c);
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d >>= 1;
-	d &= 0x7f;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x1) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
+// TSB and TRB set Z from A & d and leave N alone
+static uint8_t nsg6502_tsb(struct nsg6502_cpu *c, uint8_t d) {
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_ZERO);
+	if (!(c->a & d)) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_ZERO);
 	}
-	nsg6502_evaluate_flags(c, d);
+	return d | c->a;
 }
 
-static void nsg6502_opcode_ror_abx(struct nsg6502_cpu *c) {
-	uint16_t addr = nsg6502_fetch_word(c) + c->x;
-	uint8_t d = nsg6502_read_byte(c, addr);
-	uint8_t orig = d;
-
-	d >>= 1;
-	d &= 0x7f;
-	d |= (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY) ? 0x80 : 0);
-
-	nsg6502_write_byte(
-		c, addr,
-		d);
-
-	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_CARRY);
-	if (orig & 0x1) {
-		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_CARRY);
+static uint8_t nsg6502_trb(struct nsg6502_cpu *c, uint8_t d) {
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_ZERO);
+	if (!(c->a & d)) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_ZERO);
 	}
-	nsg6502_evaluate_flags(c, d);
+	return d & ~c->a;
 }
+#endif
 
-static void nsg6502_opcode_jmp_abs(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_jmp_abs(NSG6502_BUS_CPU *c) {
 	c->pc = nsg6502_fetch_word(c);
 }
 
-static void nsg6502_opcode_jmp_ind(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_jmp_ind(NSG6502_BUS_CPU *c) {
 	uint16_t ptr = nsg6502_fetch_word(c);
 
 	// * An indirect JMP (xxFF) will fail because the MSB will be fetched from
 	//   address xx00 instead of page xx+1.
 	// - https://www.nesdev.org/6502bugs.txt
+#ifdef NSG6502_65C02
+	// Fixed on the 65C02
+	c->pc = nsg6502_read_word(c, ptr);
+	return;
+#endif
 
 	uint16_t jump_to = 0;
 	if ((ptr & 0xFF) == 0xFF) {
@@ -1232,21 +960,24 @@ static void nsg6502_opcode_jmp_ind(struct nsg6502_cpu *c) {
 	c->pc = jump_to;
 }
 
-static void nsg6502_opcode_jsr_abs(struct nsg6502_cpu *c) {
-	uint16_t pc = c->pc + 2;
+#ifdef NSG6502_65C02
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_jmp_iax(NSG6502_BUS_CPU *c) {
+	c->pc = nsg6502_read_word(c, nsg6502_fetch_word(c) + c->x);
+}
 
-	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
-		nsg6502_stack_push_byte(c, pc & 0xFF);
-		nsg6502_stack_push_byte(c, (pc >> 8) & 0xFF);
-	} else {
-		nsg6502_stack_push_byte(c, (pc >> 8) & 0xFF);
-		nsg6502_stack_push_byte(c, pc & 0xFF);
+// BIT # only sets Z
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_bit_imm(NSG6502_BUS_CPU *c) {
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_ZERO);
+	if (!(c->a & nsg6502_fetch_byte(c))) {
+		NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_ZERO);
 	}
-
-	c->pc = nsg6502_fetch_word(c);
 }
+#endif
 
-static void nsg6502_opcode_rts(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_rts(NSG6502_BUS_CPU *c) {
 	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
 		c->pc =
 			((nsg6502_stack_pop_byte(c) << 8) | (nsg6502_stack_pop_byte(c)));
@@ -1255,79 +986,34 @@ static void nsg6502_opcode_rts(struct nsg6502_cpu *c) {
 	}
 }
 
-static void nsg6502_opcode_bvs_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_OVERFLOW)) {
-		int8_t addr_rel = nsg6502_fetch_byte(c);
-		c->pc += addr_rel;
-	} else {
-		c->pc++;
-	}
-}
-
-static void nsg6502_opcode_bvc_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_OVERFLOW)) {
-		c->pc++;
-		return;
-	}
-	int8_t addr_rel = nsg6502_fetch_byte(c);
-	c->pc += addr_rel;
-}
-
-static void nsg6502_opcode_bmi_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_NEGATIVE)) {
-		int8_t addr_rel = nsg6502_fetch_byte(c);
-		c->pc += addr_rel;
-	} else {
-		c->pc++;
-	}
-}
-
-static void nsg6502_opcode_bpl_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_NEGATIVE)) {
-		c->pc++;
-		return;
-	}
-	int8_t addr_rel = nsg6502_fetch_byte(c);
-	c->pc += addr_rel;
-}
-
-static void nsg6502_opcode_bne_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_ZERO)) {
-		c->pc++;
-		return;
-	}
-	int8_t addr_rel = nsg6502_fetch_byte(c);
-	c->pc += addr_rel;
-}
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_jsr_abs(NSG6502_BUS_CPU *c) {
+	uint16_t pc = c->pc + 2;
 
-static void nsg6502_opcode_beq_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_ZERO)) {
-		int8_t addr_rel = nsg6502_fetch_byte(c);
-		c->pc += addr_rel;
+	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
+		nsg6502_stack_push_byte(c, pc & 0xFF);
+		nsg6502_stack_push_byte(c, (pc >> 8) & 0xFF);
 	} else {
-		c->pc++;
+		nsg6502_stack_push_byte(c, (pc >> 8) & 0xFF);
+		nsg6502_stack_push_byte(c, pc & 0xFF);
 	}
-}
 
-static void nsg6502_opcode_bcc_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY)) {
-		c->pc++;
-		return;
-	}
-	int8_t addr_rel = nsg6502_fetch_byte(c);
-	c->pc += addr_rel;
-}
+	c->pc = nsg6502_fetch_word(c);
 
-static void nsg6502_opcode_bcs_rel(struct nsg6502_cpu *c) {
-	if (NSG6502_FLAG_IS_SET(c->status, NSG6502_STATUS_REGISTER_CARRY)) {
-		int8_t addr_rel = nsg6502_fetch_byte(c);
-		c->pc += addr_rel;
-	} else {
-		c->pc++;
+	if (c->traps) {
+		struct nsg6502_trap *t = nsg6502_trap_find(c, c->pc);
+		if (t) {
+			c->ticks += t->ticks;
+			// The function may read status or return a result in a flag
+			nsg6502_flags_resolve(c);
+			t->function(c, t->data);
+			nsg6502_opcode_rts(c);
+		}
 	}
 }
 
-static void nsg6502_opcode_brk(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_brk(NSG6502_BUS_CPU *c) {
 	c->pc++;
 
 	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
@@ -1341,11 +1027,15 @@ static void nsg6502_opcode_brk(struct nsg6502_cpu *c) {
 	NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_BREAK);
 	nsg6502_stack_push_byte(c, c->status);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_BREAK);
+#ifdef NSG6502_65C02
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_DECIMAL);
+#endif
 
 	c->pc = nsg6502_read_word(c, 0xFFFE);
 }
 
-static void nsg6502_opcode_rti(struct nsg6502_cpu *c) {
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_rti(NSG6502_BUS_CPU *c) {
 	c->status = nsg6502_stack_pop_byte(c);
 	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_BREAK);
 
@@ -1357,214 +1047,513 @@ static void nsg6502_opcode_rti(struct nsg6502_cpu *c) {
 	}
 }
 
+// Pushes PC and status like BRK, without the break flag, and jumps through
+// vector
+NSG6502_BUS_TEMPLATE
+static void nsg6502_interrupt(NSG6502_BUS_CPU *c, uint16_t vector) {
+	nsg6502_flags_resolve(c);
+	if (NSG6502_IS_SYSTEM_BIG_ENDIAN) {
+		nsg6502_stack_push_byte(c, c->pc & 0xFF);
+		nsg6502_stack_push_byte(c, (c->pc >> 8) & 0xFF);
+	} else {
+		nsg6502_stack_push_byte(c, (c->pc >> 8) & 0xFF);
+		nsg6502_stack_push_byte(c, c->pc & 0xFF);
+	}
+	nsg6502_stack_push_byte(c, (c->status | 0x20) &
+								   ~NSG6502_STATUS_REGISTER_BREAK);
+	NSG6502_FLAG_SET(c->status, NSG6502_STATUS_REGISTER_INTERRUPT_DISABLE);
+#ifdef NSG6502_65C02
+	NSG6502_FLAG_CLEAR(c->status, NSG6502_STATUS_REGISTER_DECIMAL);
+#endif
+	c->pc = nsg6502_read_word(c, vector);
+	c->ticks += 2;
+}
+
+static void nsg6502_nmi(struct nsg6502_cpu *c) { c->nmi = 1; }
+
+// Handlers are generated from an operation and an addressing mode, one
+// generator per kind of instruction, and named nsg6502_opcode_<op>_<mode>.
+// Implied instructions and the SPECIAL ones, mostly jumps, are written out
+// above.
+#define NSG6502_GENERATE_READ(op, mode)                                        \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static void nsg6502_opcode_##op##_##mode(NSG6502_BUS_CPU *c) {             \
+		nsg6502_##op(c, nsg6502_operand_##mode(c));                            \
+	}
+
+#define NSG6502_GENERATE_WRITE(op, mode)                                       \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static void nsg6502_opcode_##op##_##mode(NSG6502_BUS_CPU *c) {             \
+		uint16_t addr = nsg6502_addr_##mode(c);                                \
+		nsg6502_write_byte(c, addr, nsg6502_##op(c));                          \
+	}
+
+#define NSG6502_GENERATE_MODIFY(op, mode)                                      \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static void nsg6502_opcode_##op##_##mode(NSG6502_BUS_CPU *c) {             \
+		uint16_t addr = nsg6502_addr_##mode(c);                                \
+		uint8_t d = nsg6502_##op(c, nsg6502_read_byte(c, addr));               \
+		nsg6502_write_byte(c, addr, d);                                        \
+		nsg6502_evaluate_flags(c, d);                                          \
+	}
+
+#define NSG6502_GENERATE_ACCUMULATOR(op, mode)                                 \
+	static void nsg6502_opcode_##op##_##mode(struct nsg6502_cpu *c) {          \
+		c->a = nsg6502_##op(c, c->a);                                          \
+		nsg6502_evaluate_flags(c, c->a);                                       \
+	}
+
+#define NSG6502_GENERATE_BRANCH(op, mode)                                      \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static void nsg6502_opcode_##op##_##mode(NSG6502_BUS_CPU *c) {             \
+		if (nsg6502_cond_##op(c)) {                                            \
+			int8_t addr_rel = nsg6502_fetch_byte(c);                           \
+			c->pc += addr_rel;                                                 \
+		} else {                                                               \
+			c->pc++;                                                           \
+		}                                                                      \
+	}
+
+#ifdef NSG6502_65C02
+// TSB and TRB, which set their own flags
+#define NSG6502_GENERATE_TEST(op, mode)                                        \
+	NSG6502_BUS_TEMPLATE                                                       \
+	static void nsg6502_opcode_##op##_##mode(NSG6502_BUS_CPU *c) {             \
+		uint16_t addr = nsg6502_addr_##mode(c);                                \
+		uint8_t data = nsg6502_read_byte(c, addr);                             \
+		nsg6502_write_byte(c, addr, nsg6502_##op(c, data));                    \
+	}
+#endif
+
+#define NSG6502_GENERATE_SPECIAL(op, mode)
+#define NSG6502_GENERATE_IMPLIED(op, mode)
+
+#define NSG6502_HANDLER_READ(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_WRITE(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_MODIFY(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_ACCUMULATOR(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_BRANCH(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_TEST(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_SPECIAL(op, mode) nsg6502_opcode_##op##_##mode
+#define NSG6502_HANDLER_IMPLIED(op, mode) nsg6502_opcode_##op
+
+// Addressing modes as they appear in the table names
+#define NSG6502_MODE_NAME_imp ""
+#define NSG6502_MODE_NAME_a " A"
+#define NSG6502_MODE_NAME_rel " REL"
+#define NSG6502_MODE_NAME_ind " IND"
+#define NSG6502_MODE_NAME_imm " #"
+#define NSG6502_MODE_NAME_zp " ZP"
+#define NSG6502_MODE_NAME_zpx " ZP, X"
+#define NSG6502_MODE_NAME_zpy " ZP, Y"
+#define NSG6502_MODE_NAME_abs " ABS"
+#define NSG6502_MODE_NAME_abx " ABS, X"
+#define NSG6502_MODE_NAME_aby " ABS, Y"
+#define NSG6502_MODE_NAME_inx " INX"
+#define NSG6502_MODE_NAME_iny " INY"
+#define NSG6502_MODE_NAME_zpi " ZPI"
+#define NSG6502_MODE_NAME_iax " IAX"
+
+// Every opcode: its byte, mnemonic, kind of instruction, operation,
+// addressing mode and the ticks charged on top of its bus accesses.
 // Cycle count might be incorrect
 // Not bothered to fix it
+#define NSG6502_INSTRUCTIONS(X)                                                \
+	X(0x00, "BRK", IMPLIED, brk, imp, 1)                                       \
+	X(0x40, "RTI", IMPLIED, rti, imp, 1)                                       \
+	X(0x20, "JSR", SPECIAL, jsr, abs, 1)                                       \
+	X(0x60, "RTS", IMPLIED, rts, imp, 1)                                       \
+	X(0x90, "BCC", BRANCH, bcc, rel, 1)                                        \
+	X(0xB0, "BCS", BRANCH, bcs, rel, 1)                                        \
+	X(0xD0, "BNE", BRANCH, bne, rel, 1)                                        \
+	X(0xF0, "BEQ", BRANCH, beq, rel, 1)                                        \
+	X(0x50, "BVC", BRANCH, bvc, rel, 1)                                        \
+	X(0x70, "BVS", BRANCH, bvs, rel, 1)                                        \
+	X(0x10, "BPL", BRANCH, bpl, rel, 1)                                        \
+	X(0x30, "BMI", BRANCH, bmi, rel, 1)                                        \
+	X(0x4C, "JMP", SPECIAL, jmp, abs, 1)                                       \
+	X(0x6C, "JMP", SPECIAL, jmp, ind, 1)                                       \
+	X(0x6A, "ROR", ACCUMULATOR, ror, a, 1)                                     \
+	X(0x66, "ROR", MODIFY, ror, zp, 1)                                         \
+	X(0x76, "ROR", MODIFY, ror, zpx, 2)                                        \
+	X(0x6E, "ROR", MODIFY, ror, abs, 1)                                        \
+	X(0x7E, "ROR", MODIFY, ror, abx, 1)                                        \
+	X(0x2A, "ROL", ACCUMULATOR, rol, a, 1)                                     \
+	X(0x26, "ROL", MODIFY, rol, zp, 1)                                         \
+	X(0x36, "ROL", MODIFY, rol, zpx, 2)                                        \
+	X(0x2E, "ROL", MODIFY, rol, abs, 1)                                        \
+	X(0x3E, "ROL", MODIFY, rol, abx, 1)                                        \
+	X(0x4A, "LSR", ACCUMULATOR, lsr, a, 1)                                     \
+	X(0x46, "LSR", MODIFY, lsr, zp, 1)                                         \
+	X(0x56, "LSR", MODIFY, lsr, zpx, 2)                                        \
+	X(0x4E, "LSR", MODIFY, lsr, abs, 1)                                        \
+	X(0x5E, "LSR", MODIFY, lsr, abx, 1)                                        \
+	X(0x0A, "ASL", ACCUMULATOR, asl, a, 1)                                     \
+	X(0x06, "ASL", MODIFY, asl, zp, 1)                                         \
+	X(0x16, "ASL", MODIFY, asl, zpx, 2)                                        \
+	X(0x0E, "ASL", MODIFY, asl, abs, 1)                                        \
+	X(0x1E, "ASL", MODIFY, asl, abx, 1)                                        \
+	X(0x24, "BIT", READ, bit, zp, 1)                                           \
+	X(0x2C, "BIT", READ, bit, abs, 1)                                          \
+	X(0xC0, "CPY", READ, cpy, imm, 1)                                          \
+	X(0xC4, "CPY", READ, cpy, zp, 1)                                           \
+	X(0xCC, "CPY", READ, cpy, abs, 1)                                          \
+	X(0xE0, "CPX", READ, cpx, imm, 1)                                          \
+	X(0xE4, "CPX", READ, cpx, zp, 2)                                           \
+	X(0xEC, "CPX", READ, cpx, abs, 1)                                          \
+	X(0xC9, "CMP", READ, cmp, imm, 1)                                          \
+	X(0xC5, "CMP", READ, cmp, zp, 1)                                           \
+	X(0xD5, "CMP", READ, cmp, zpx, 2)                                          \
+	X(0xCD, "CMP", READ, cmp, abs, 1)                                          \
+	X(0xDD, "CMP", READ, cmp, abx, 1)                                          \
+	X(0xD9, "CMP", READ, cmp, aby, 1)                                          \
+	X(0xC1, "CMP", READ, cmp, inx, 1)                                          \
+	X(0xD1, "CMP", READ, cmp, iny, 1)                                          \
+	X(0xE9, "SBC", READ, sbc, imm, 1)                                          \
+	X(0xE5, "SBC", READ, sbc, zp, 1)                                           \
+	X(0xF5, "SBC", READ, sbc, zpx, 2)                                          \
+	X(0xED, "SBC", READ, sbc, abs, 1)                                          \
+	X(0xFD, "SBC", READ, sbc, abx, 1)                                          \
+	X(0xF9, "SBC", READ, sbc, aby, 1)                                          \
+	X(0xE1, "SBC", READ, sbc, inx, 1)                                          \
+	X(0xF1, "SBC", READ, sbc, iny, 1)                                          \
+	X(0x69, "ADC", READ, adc, imm, 1)                                          \
+	X(0x65, "ADC", READ, adc, zp, 1)                                           \
+	X(0x75, "ADC", READ, adc, zpx, 2)                                          \
+	X(0x6D, "ADC", READ, adc, abs, 1)                                          \
+	X(0x7D, "ADC", READ, adc, abx, 1)                                          \
+	X(0x79, "ADC", READ, adc, aby, 1)                                          \
+	X(0x61, "ADC", READ, adc, inx, 1)                                          \
+	X(0x71, "ADC", READ, adc, iny, 1)                                          \
+	X(0x49, "EOR", READ, eor, imm, 1)                                          \
+	X(0x45, "EOR", READ, eor, zp, 1)                                           \
+	X(0x55, "EOR", READ, eor, zpx, 2)                                          \
+	X(0x4D, "EOR", READ, eor, abs, 1)                                          \
+	X(0x5D, "EOR", READ, eor, abx, 1)                                          \
+	X(0x59, "EOR", READ, eor, aby, 1)                                          \
+	X(0x41, "EOR", READ, eor, inx, 1)                                          \
+	X(0x51, "EOR", READ, eor, iny, 1)                                          \
+	X(0x29, "AND", READ, and, imm, 1)                                          \
+	X(0x25, "AND", READ, and, zp, 1)                                           \
+	X(0x35, "AND", READ, and, zpx, 2)                                          \
+	X(0x2D, "AND", READ, and, abs, 1)                                          \
+	X(0x3D, "AND", READ, and, abx, 1)                                          \
+	X(0x39, "AND", READ, and, aby, 1)                                          \
+	X(0x21, "AND", READ, and, inx, 1)                                          \
+	X(0x31, "AND", READ, and, iny, 1)                                          \
+	X(0x09, "ORA", READ, ora, imm, 1)                                          \
+	X(0x05, "ORA", READ, ora, zp, 1)                                           \
+	X(0x15, "ORA", READ, ora, zpx, 2)                                          \
+	X(0x0D, "ORA", READ, ora, abs, 1)                                          \
+	X(0x1D, "ORA", READ, ora, abx, 1)                                          \
+	X(0x19, "ORA", READ, ora, aby, 1)                                          \
+	X(0x01, "ORA", READ, ora, inx, 1)                                          \
+	X(0x11, "ORA", READ, ora, iny, 1)                                          \
+	X(0x08, "PHP", IMPLIED, php, imp, 1)                                       \
+	X(0x28, "PLP", IMPLIED, plp, imp, 1)                                       \
+	X(0x48, "PHA", IMPLIED, pha, imp, 1)                                       \
+	X(0x68, "PLA", IMPLIED, pla, imp, 1)                                       \
+	X(0x8A, "TXA", IMPLIED, txa, imp, 1)                                       \
+	X(0x98, "TYA", IMPLIED, tya, imp, 1)                                       \
+	X(0x9A, "TXS", IMPLIED, txs, imp, 1)                                       \
+	X(0xAA, "TAX", IMPLIED, tax, imp, 1)                                       \
+	X(0xA8, "TAY", IMPLIED, tay, imp, 1)                                       \
+	X(0xBA, "TSX", IMPLIED, tsx, imp, 1)                                       \
+	X(0x84, "STY", WRITE, sty, zp, 1)                                          \
+	X(0x94, "STY", WRITE, sty, zpx, 2)                                         \
+	X(0x8C, "STY", WRITE, sty, abs, 1)                                         \
+	X(0x86, "STX", WRITE, stx, zp, 1)                                          \
+	X(0x96, "STX", WRITE, stx, zpy, 2)                                         \
+	X(0x8E, "STX", WRITE, stx, abs, 1)                                         \
+	X(0x85, "STA", WRITE, sta, zp, 1)                                          \
+	X(0x95, "STA", WRITE, sta, zpx, 2)                                         \
+	X(0x8D, "STA", WRITE, sta, abs, 1)                                         \
+	X(0x9D, "STA", WRITE, sta, abx, 1)                                         \
+	X(0x99, "STA", WRITE, sta, aby, 1)                                         \
+	X(0x81, "STA", WRITE, sta, inx, 1)                                         \
+	X(0x91, "STA", WRITE, sta, iny, 1)                                         \
+	X(0x38, "SEC", IMPLIED, sec, imp, 1)                                       \
+	X(0xF8, "SED", IMPLIED, sed, imp, 1)                                       \
+	X(0x78, "SEI", IMPLIED, sei, imp, 1)                                       \
+	X(0xA0, "LDY", READ, ldy, imm, 1)                                          \
+	X(0xA4, "LDY", READ, ldy, zp, 1)                                           \
+	X(0xB4, "LDY", READ, ldy, zpx, 2)                                          \
+	X(0xAC, "LDY", READ, ldy, abs, 1)                                          \
+	X(0xBC, "LDY", READ, ldy, abx, 1)                                          \
+	X(0xA2, "LDX", READ, ldx, imm, 1)                                          \
+	X(0xA6, "LDX", READ, ldx, zp, 1)                                           \
+	X(0xB6, "LDX", READ, ldx, zpy, 2)                                          \
+	X(0xAE, "LDX", READ, ldx, abs, 1)                                          \
+	X(0xBE, "LDX", READ, ldx, aby, 1)                                          \
+	X(0xA9, "LDA", READ, lda, imm, 1)                                          \
+	X(0xA5, "LDA", READ, lda, zp, 1)                                           \
+	X(0xB5, "LDA", READ, lda, zpx, 2)                                          \
+	X(0xAD, "LDA", READ, lda, abs, 1)                                          \
+	X(0xBD, "LDA", READ, lda, abx, 1)                                          \
+	X(0xB9, "LDA", READ, lda, aby, 1)                                          \
+	X(0xA1, "LDA", READ, lda, inx, 1)                                          \
+	X(0xB1, "LDA", READ, lda, iny, 1)                                          \
+	X(0xE8, "INX", IMPLIED, inx, imp, 1)                                       \
+	X(0xC8, "INY", IMPLIED, iny, imp, 1)                                       \
+	X(0xE6, "INC", MODIFY, inc, zp, 1)                                         \
+	X(0xF6, "INC", MODIFY, inc, zpx, 2)                                        \
+	X(0xEE, "INC", MODIFY, inc, abs, 1)                                        \
+	X(0xFE, "INC", MODIFY, inc, abx, 2)                                        \
+	X(0xCA, "DEX", IMPLIED, dex, imp, 1)                                       \
+	X(0x88, "DEY", IMPLIED, dey, imp, 1)                                       \
+	X(0xC6, "DEC", MODIFY, dec, zp, 1)                                         \
+	X(0xD6, "DEC", MODIFY, dec, zpx, 2)                                        \
+	X(0xCE, "DEC", MODIFY, dec, abs, 1)                                        \
+	X(0xDE, "DEC", MODIFY, dec, abx, 2)                                        \
+	X(0x18, "CLC", IMPLIED, clc, imp, 1)                                       \
+	X(0xD8, "CLD", IMPLIED, cld, imp, 1)                                       \
+	X(0x58, "CLI", IMPLIED, cli, imp, 1)                                       \
+	X(0xB8, "CLV", IMPLIED, clv, imp, 1)                                       \
+	X(0xEA, "NOP", IMPLIED, nop, imp, 1)
+
+#ifdef NSG6502_65C02
+// Added on the 65C02, on top of the list above
+#define NSG6502_INSTRUCTIONS_65C02(X)                                          \
+	X(0x12, "ORA", READ, ora, zpi, 1)                                          \
+	X(0x32, "AND", READ, and, zpi, 1)                                          \
+	X(0x52, "EOR", READ, eor, zpi, 1)                                          \
+	X(0x72, "ADC", READ, adc, zpi, 1)                                          \
+	X(0x92, "STA", WRITE, sta, zpi, 1)                                         \
+	X(0xB2, "LDA", READ, lda, zpi, 1)                                          \
+	X(0xD2, "CMP", READ, cmp, zpi, 1)                                          \
+	X(0xF2, "SBC", READ, sbc, zpi, 1)                                          \
+	X(0x80, "BRA", BRANCH, bra, rel, 1)                                        \
+	X(0xDA, "PHX", IMPLIED, phx, imp, 1)                                       \
+	X(0xFA, "PLX", IMPLIED, plx, imp, 1)                                       \
+	X(0x5A, "PHY", IMPLIED, phy, imp, 1)                                       \
+	X(0x7A, "PLY", IMPLIED, ply, imp, 1)                                       \
+	X(0x64, "STZ", WRITE, stz, zp, 1)                                          \
+	X(0x74, "STZ", WRITE, stz, zpx, 2)                                         \
+	X(0x9C, "STZ", WRITE, stz, abs, 1)                                         \
+	X(0x9E, "STZ", WRITE, stz, abx, 1)                                         \
+	X(0x04, "TSB", TEST, tsb, zp, 1)                                           \
+	X(0x0C, "TSB", TEST, tsb, abs, 1)                                          \
+	X(0x14, "TRB", TEST, trb, zp, 1)                                           \
+	X(0x1C, "TRB", TEST, trb, abs, 1)                                          \
+	X(0x1A, "INC", ACCUMULATOR, inc, a, 1)                                     \
+	X(0x3A, "DEC", ACCUMULATOR, dec, a, 1)                                     \
+	X(0x34, "BIT", READ, bit, zpx, 2)                                          \
+	X(0x3C, "BIT", READ, bit, abx, 1)                                          \
+	X(0x89, "BIT", SPECIAL, bit, imm, 1)                                       \
+	X(0x7C, "JMP", SPECIAL, jmp, iax, 1)                                       \
+	X(0xCB, "WAI", IMPLIED, wai, imp, 1)                                       \
+	X(0xDB, "STP", IMPLIED, stp, imp, 1)
+#else
+#define NSG6502_INSTRUCTIONS_65C02(X)
+#endif
+
+#define NSG6502_GENERATE(opcode, mnemonic, kind, op, mode, ticks)              \
+	NSG6502_GENERATE_##kind(op, mode)
+#define NSG6502_ENTRY(opcode, mnemonic, kind, op, mode, ticks)                 \
+	[opcode] = {mnemonic NSG6502_MODE_NAME_##mode, ticks,                      \
+				NSG6502_HANDLER_##kind(op, mode)},
+
+NSG6502_INSTRUCTIONS(NSG6502_GENERATE)
+NSG6502_INSTRUCTIONS_65C02(NSG6502_GENERATE)
+
+#ifdef __cplusplus
+// C++ has no array designators, the table is filled in when the program
+// starts. Its handlers are the ones for struct nsg6502_cpu.
+#define NSG6502_ASSIGN(opcode, mnemonic, kind, op, mode, cycles)               \
+	entries[opcode].name = mnemonic NSG6502_MODE_NAME_##mode;                  \
+	entries[opcode].ticks = cycles;                                            \
+	entries[opcode].function = NSG6502_HANDLER_##kind(op, mode);
+
+static const struct nsg6502_opcode_table {
+	struct nsg6502_opcode entries[256];
+
+	nsg6502_opcode_table() : entries() {
+		NSG6502_INSTRUCTIONS(NSG6502_ASSIGN)
+		NSG6502_INSTRUCTIONS_65C02(NSG6502_ASSIGN)
+	}
+	const struct nsg6502_opcode &operator[](size_t i) const {
+		return entries[i];
+	}
+} NSG6502_OPCODES;
+
+// Runs the handler instantiated for the CPU type at hand, its ticks are a
+// constant here
+#define NSG6502_CASE(opcode, mnemonic, kind, op, mode, cycles)                 \
+	case opcode:                                                               \
+		nsg6502_opcode_prepare(c, opcode);                                     \
+		c->ticks += cycles;                                                    \
+		NSG6502_HANDLER_##kind(op, mode)(c);                                   \
+		break;
+#else
 const struct nsg6502_opcode NSG6502_OPCODES[256] = {
-	[0x00] = {"BRK", 1, nsg6502_opcode_brk},
-	[0x40] = {"RTI", 1, nsg6502_opcode_rti},
-
-	[0x20] = {"JSR ABS", 1, nsg6502_opcode_jsr_abs},
-	[0x60] = {"RTS", 1, nsg6502_opcode_rts},
-
-	[0x90] = {"BCC REL", 1, nsg6502_opcode_bcc_rel},
-	[0xB0] = {"BCS REL", 1, nsg6502_opcode_bcs_rel},
-
-	[0xD0] = {"BNE REL", 1, nsg6502_opcode_bne_rel},
-	[0xF0] = {"BEQ REL", 1, nsg6502_opcode_beq_rel},
-
-	[0x50] = {"BVC REL", 1, nsg6502_opcode_bvc_rel},
-	[0x70] = {"BVS REL", 1, nsg6502_opcode_bvs_rel},
-
-	[0x10] = {"BPL REL", 1, nsg6502_opcode_bpl_rel},
-	[0x30] = {"BMI REL", 1, nsg6502_opcode_bmi_rel},
-
-	[0x4C] = {"JMP ABS", 1, nsg6502_opcode_jmp_abs},
-	[0x6C] = {"JMP IND", 1, nsg6502_opcode_jmp_ind},
-
-	[0x6A] = {"ROR A", 1, nsg6502_opcode_ror_a},
-	[0x66] = {"ROR ZP", 1, nsg6502_opcode_ror_zp},
-	[0x76] = {"ROR ZP, X", 2, nsg6502_opcode_ror_zpx},
-	[0x6E] = {"ROR ABS", 1, nsg6502_opcode_ror_abs},
-	[0x7E] = {"ROR ABS, X", 1, nsg6502_opcode_ror_abx},
-
-	[0x2A] = {"ROL A", 1, nsg6502_opcode_rol_a},
-	[0x26] = {"ROL ZP", 1, nsg6502_opcode_rol_zp},
-	[0x36] = {"ROL ZP, X", 2, nsg6502_opcode_rol_zpx},
-	[0x2E] = {"ROL ABS", 1, nsg6502_opcode_rol_abs},
-	[0x3E] = {"ROL ABS, X", 1, nsg6502_opcode_rol_abx},
-
-	[0x4A] = {"LSR A", 1, nsg6502_opcode_lsr_a},
-	[0x46] = {"LSR ZP", 1, nsg6502_opcode_lsr_zp},
-	[0x56] = {"LSR ZP, X", 2, nsg6502_opcode_lsr_zpx},
-	[0x4E] = {"LSR ABS", 1, nsg6502_opcode_lsr_abs},
-	[0x5E] = {"LSR ABS, X", 1, nsg6502_opcode_lsr_abx},
-
-	[0x0A] = {"ASL A", 1, nsg6502_opcode_asl_a},
-	[0x06] = {"ASL ZP", 1, nsg6502_opcode_asl_zp},
-	[0x16] = {"ASL ZP, X", 2, nsg6502_opcode_asl_zpx},
-	[0x0E] = {"ASL ABS", 1, nsg6502_opcode_asl_abs},
-	[0x1E] = {"ASL ABS, X", 1, nsg6502_opcode_asl_abx},
-
-	[0x24] = {"BIT ZP", 1, nsg6502_opcode_bit_zp},
-	[0x2C] = {"BIT ABS", 1, nsg6502_opcode_bit_abs},
-
-	[0xC0] = {"CPY #", 1, nsg6502_opcode_cpy_imm},
-	[0xC4] = {"CPY ZP", 1, nsg6502_opcode_cpy_zp},
-	[0xCC] = {"CPY ABS", 1, nsg6502_opcode_cpy_abs},
-
-	[0xE0] = {"CPX #", 1, nsg6502_opcode_cpx_imm},
-	[0xE4] = {"CPX ZP", 2, nsg6502_opcode_cpx_zp},
-	[0xEC] = {"CPX ABS", 1, nsg6502_opcode_cpx_abs},
-
-	[0xC9] = {"CMP #", 1, nsg6502_opcode_cmp_imm},
-	[0xC5] = {"CMP ZP", 1, nsg6502_opcode_cmp_zp},
-	[0xD5] = {"CMP ZP, X", 2, nsg6502_opcode_cmp_zpx},
-	[0xCD] = {"CMP ABS", 1, nsg6502_opcode_cmp_abs},
-	[0xDD] = {"CMP ABS, X", 1, nsg6502_opcode_cmp_abx},
-	[0xD9] = {"CMP ABS, Y", 1, nsg6502_opcode_cmp_aby},
-	[0xC1] = {"CMP INX", 1, nsg6502_opcode_cmp_inx},
-	[0xD1] = {"CMP INY", 1, nsg6502_opcode_cmp_iny},
-
-	[0xE9] = {"SBC #", 1, nsg6502_opcode_sbc_imm},
-	[0xE5] = {"SBC ZP", 1, nsg6502_opcode_sbc_zp},
-	[0xF5] = {"SBC ZP, X", 2, nsg6502_opcode_sbc_zpx},
-	[0xED] = {"SBC ABS", 1, nsg6502_opcode_sbc_abs},
-	[0xFD] = {"SBC ABS, X", 1, nsg6502_opcode_sbc_abx},
-	[0xF9] = {"SBC ABS, Y", 1, nsg6502_opcode_sbc_aby},
-	[0xE1] = {"SBC INX", 1, nsg6502_opcode_sbc_inx},
-	[0xF1] = {"SBC INY", 1, nsg6502_opcode_sbc_iny},
-
-	[0x69] = {"ADC #", 1, nsg6502_opcode_adc_imm},
-	[0x65] = {"ADC ZP", 1, nsg6502_opcode_adc_zp},
-	[0x75] = {"ADC ZP, X", 2, nsg6502_opcode_adc_zpx},
-	[0x6D] = {"ADC ABS", 1, nsg6502_opcode_adc_abs},
-	[0x7D] = {"ADC ABS, X", 1, nsg6502_opcode_adc_abx},
-	[0x79] = {"ADC ABS, Y", 1, nsg6502_opcode_adc_aby},
-	[0x61] = {"ADC INX", 1, nsg6502_opcode_adc_inx},
-	[0x71] = {"ADC INY", 1, nsg6502_opcode_adc_iny},
-
-	[0x49] = {"EOR #", 1, nsg6502_opcode_eor_imm},
-	[0x45] = {"EOR ZP", 1, nsg6502_opcode_eor_zp},
-	[0x55] = {"EOR ZP, X", 2, nsg6502_opcode_eor_zpx},
-	[0x4D] = {"EOR ABS", 1, nsg6502_opcode_eor_abs},
-	[0x5D] = {"EOR ABS, X", 1, nsg6502_opcode_eor_abx},
-	[0x59] = {"EOR ABS, Y", 1, nsg6502_opcode_eor_aby},
-	[0x41] = {"EOR INX", 1, nsg6502_opcode_eor_inx},
-	[0x51] = {"EOR INY", 1, nsg6502_opcode_eor_iny},
-
-	[0x29] = {"AND #", 1, nsg6502_opcode_and_imm},
-	[0x25] = {"AND ZP", 1, nsg6502_opcode_and_zp},
-	[0x35] = {"AND ZP, X", 2, nsg6502_opcode_and_zpx},
-	[0x2D] = {"AND ABS", 1, nsg6502_opcode_and_abs},
-	[0x3D] = {"AND ABS, X", 1, nsg6502_opcode_and_abx},
-	[0x39] = {"AND ABS, Y", 1, nsg6502_opcode_and_aby},
-	[0x21] = {"AND INX", 1, nsg6502_opcode_and_inx},
-	[0x31] = {"AND INY", 1, nsg6502_opcode_and_iny},
-
-	[0x09] = {"ORA #", 1, nsg6502_opcode_ora_imm},
-	[0x05] = {"ORA ZP", 1, nsg6502_opcode_ora_zp},
-	[0x15] = {"ORA ZP, X", 2, nsg6502_opcode_ora_zpx},
-	[0x0D] = {"ORA ABS", 1, nsg6502_opcode_ora_abs},
-	[0x1D] = {"ORA ABS, X", 1, nsg6502_opcode_ora_abx},
-	[0x19] = {"ORA ABS, Y", 1, nsg6502_opcode_ora_aby},
-	[0x01] = {"ORA INX", 1, nsg6502_opcode_ora_inx},
-	[0x11] = {"ORA INY", 1, nsg6502_opcode_ora_iny},
-
-	[0x08] = {"PHP", 1, nsg6502_opcode_php},
-	[0x28] = {"PLP", 1, nsg6502_opcode_plp},
-
-	[0x48] = {"PHA", 1, nsg6502_opcode_pha},
-	[0x68] = {"PLA", 1, nsg6502_opcode_pla},
-
-	[0x8A] = {"TXA", 1, nsg6502_opcode_txa},
-	[0x98] = {"TYA", 1, nsg6502_opcode_tya},
-	[0x9A] = {"TXS", 1, nsg6502_opcode_txs},
-
-	[0xAA] = {"TAX", 1, nsg6502_opcode_tax},
-	[0xA8] = {"TAY", 1, nsg6502_opcode_tay},
-	[0xBA] = {"TSX", 1, nsg6502_opcode_tsx},
-
-	[0x84] = {"STY ZP", 1, nsg6502_opcode_sty_zp},
-	[0x94] = {"STY ZP, X", 2, nsg6502_opcode_sty_zpx},
-	[0x8C] = {"STY ABS", 1, nsg6502_opcode_sty_abs},
-
-	[0x86] = {"STX ZP", 1, nsg6502_opcode_stx_zp},
-	[0x96] = {"STX ZP, Y", 2, nsg6502_opcode_stx_zpy},
-	[0x8E] = {"STX ABS", 1, nsg6502_opcode_stx_abs},
-
-	[0x85] = {"STA ZP", 1, nsg6502_opcode_sta_zp},
-	[0x95] = {"STA ZP, X", 2, nsg6502_opcode_sta_zpx},
-	[0x8D] = {"STA ABS", 1, nsg6502_opcode_sta_abs},
-	[0x9D] = {"STA ABX", 1, nsg6502_opcode_sta_abx},
-	[0x99] = {"STA ABY", 1, nsg6502_opcode_sta_aby},
-	[0x81] = {"STA INX", 1, nsg6502_opcode_sta_inx},
-	[0x91] = {"STA INY", 1, nsg6502_opcode_sta_iny},
-
-	[0x38] = {"SEC", 1, nsg6502_opcode_sec},
-	[0xF8] = {"SED", 1, nsg6502_opcode_sed},
-	[0x78] = {"SEI", 1, nsg6502_opcode_sei},
-
-	[0xA0] = {"LDY #", 1, nsg6502_opcode_ldy_imm},
-	[0xA4] = {"LDY ZP", 1, nsg6502_opcode_ldy_zp},
-	[0xB4] = {"LDY ZP, X", 2, nsg6502_opcode_ldy_zpx},
-	[0xAC] = {"LDY ABS", 1, nsg6502_opcode_ldy_abs},
-	[0xBC] = {"LDY ABX", 1, nsg6502_opcode_ldy_zpx},
-
-	[0xA2] = {"LDX #", 1, nsg6502_opcode_ldx_imm},
-	[0xA6] = {"LDX ZP", 1, nsg6502_opcode_ldx_zp},
-	[0xB6] = {"LDX ZP, Y", 2, nsg6502_opcode_ldx_zpy},
-	[0xAE] = {"LDX ABS", 1, nsg6502_opcode_ldx_abs},
-	[0xBE] = {"LDX ABY", 1, nsg6502_opcode_ldx_aby},
-
-	[0xA9] = {"LDA #", 1, nsg6502_opcode_lda_imm},
-	[0xA5] = {"LDA ZP", 1, nsg6502_opcode_lda_zp},
-	[0xB5] = {"LDA ZP, X", 2, nsg6502_opcode_lda_zpx},
-	[0xAD] = {"LDA ABS", 1, nsg6502_opcode_lda_abs},
-	[0xBD] = {"LDA ABX", 1, nsg6502_opcode_lda_abx},
-	[0xB9] = {"LDA ABY", 1, nsg6502_opcode_lda_aby},
-	[0xA1] = {"LDA INX", 1, nsg6502_opcode_lda_inx},
-	[0xB1] = {"LDA INY", 1, nsg6502_opcode_lda_iny},
-
-	[0xE8] = {"INX", 1, nsg6502_opcode_inx},
-	[0xC8] = {"INY", 1, nsg6502_opcode_iny},
-
-	[0xE6] = {"INC ZP", 1, nsg6502_opcode_inc_zp},
-	[0xF6] = {"INC ZP, X", 2, nsg6502_opcode_inc_zpx},
-	[0xEE] = {"INC ABS", 1, nsg6502_opcode_inc_abs},
-	[0xFE] = {"INC ABS, X", 2, nsg6502_opcode_inc_absx},
-
-	[0xCA] = {"DEX", 1, nsg6502_opcode_dex},
-	[0x88] = {"DEY", 1, nsg6502_opcode_dey},
-
-	[0xC6] = {"DEC ZP", 1, nsg6502_opcode_dec_zp},
-	[0xD6] = {"DEC ZP, X", 2, nsg6502_opcode_dec_zpx},
-	[0xCE] = {"DEC ABS", 1, nsg6502_opcode_dec_abs},
-	[0xDE] = {"DEC ABS, X", 2, nsg6502_opcode_dec_abx},
-
-	[0x18] = {"CLC", 1, nsg6502_opcode_clc},
-	[0xD8] = {"CLD", 1, nsg6502_opcode_cld},
-	[0x58] = {"CLI", 1, nsg6502_opcode_cli},
-	[0xB8] = {"CLV", 1, nsg6502_opcode_clv},
-
-	[0xEA] = {"NOP", 1, nsg6502_opcode_nop}};
-
-void nsg6502_opcode_execute(struct nsg6502_cpu *c) {
-	uint8_t opcode_byte = nsg6502_fetch_byte(c);
+	NSG6502_INSTRUCTIONS(NSG6502_ENTRY)
+		NSG6502_INSTRUCTIONS_65C02(NSG6502_ENTRY)};
+#endif
+
+#ifdef NSG6502_LAZY_FLAGS
+// Opcodes that read N/Z/C or update them one bit at a time. The pending
+// flags are materialized before any of these runs. Branches are left out,
+// they go through nsg6502_flag_test.
+#define NSG6502_LAZY_OPCODES(X)                                                \
+	X(0x00) X(0x40) X(0x08) X(0x28)                                            \
+                                                                               \
+	X(0x69) X(0x65) X(0x75) X(0x6D) X(0x7D) X(0x79) X(0x61) X(0x71)            \
+	X(0xE9) X(0xE5) X(0xF5) X(0xED) X(0xFD) X(0xF9) X(0xE1) X(0xF1)            \
+                                                                               \
+	X(0x6A) X(0x66) X(0x76) X(0x6E) X(0x7E)                                    \
+	X(0x2A) X(0x26) X(0x36) X(0x2E) X(0x3E)                                    \
+	X(0x4A) X(0x46) X(0x56) X(0x4E) X(0x5E)                                    \
+	X(0x0A) X(0x06) X(0x16) X(0x0E) X(0x1E)                                    \
+                                                                               \
+	X(0x38) X(0x18)
+
+#ifdef NSG6502_65C02
+#define NSG6502_LAZY_OPCODES_65C02(X)                                          \
+	X(0x72) X(0xF2) X(0x89) X(0x04) X(0x0C) X(0x14) X(0x1C)
+#else
+#define NSG6502_LAZY_OPCODES_65C02(X)
+#endif
 
+#ifdef __cplusplus
+#define NSG6502_LAZY_ASSIGN(opcode) entries[opcode] = 1;
+
+static const struct nsg6502_lazy_table {
+	uint8_t entries[256];
+
+	nsg6502_lazy_table() : entries() {
+		NSG6502_LAZY_OPCODES(NSG6502_LAZY_ASSIGN)
+		NSG6502_LAZY_OPCODES_65C02(NSG6502_LAZY_ASSIGN)
+	}
+	uint8_t operator[](size_t i) const { return entries[i]; }
+} NSG6502_LAZY_RESOLVE;
+#else
+#define NSG6502_LAZY_ENTRY(opcode) [opcode] = 1,
+
+static const uint8_t NSG6502_LAZY_RESOLVE[256] = {
+	NSG6502_LAZY_OPCODES(NSG6502_LAZY_ENTRY)
+		NSG6502_LAZY_OPCODES_65C02(NSG6502_LAZY_ENTRY)};
+#endif
+#endif
+
+// Done before the handler of every opcode that has one
+static void nsg6502_opcode_prepare(struct nsg6502_cpu *c,
+								   uint8_t opcode_byte) {
+#ifdef NSG6502_DEBUG
+	NSG6502_DEBUG_PRINT("NSG6502: 0x%hx -> %s\n", c->pc - 1,
+						NSG6502_OPCODES[opcode_byte].name);
+#endif
+#ifdef NSG6502_LAZY_FLAGS
+	if (NSG6502_LAZY_RESOLVE[opcode_byte]) {
+		nsg6502_flags_resolve(c);
+	}
+#endif
+}
+
+// Runs the instruction opcode_byte, already fetched
+NSG6502_BUS_TEMPLATE
+static void nsg6502_opcode_dispatch(NSG6502_BUS_CPU *c,
+									uint8_t opcode_byte) {
+#ifdef __cplusplus
+	switch (opcode_byte) {
+		NSG6502_INSTRUCTIONS(NSG6502_CASE)
+		NSG6502_INSTRUCTIONS_65C02(NSG6502_CASE)
+		default:
+			return;
+	}
+#else
 	struct nsg6502_opcode opcode = NSG6502_OPCODES[opcode_byte];
 	if (!opcode.function) {
 		return;
 	}
-#ifdef NSG6502_DEBUG
-	NSG6502_DEBUG_PRINT("NSG6502: 0x%hx -> %s\n", c->pc - 1, opcode.name);
-#endif
+	nsg6502_opcode_prepare(c, opcode_byte);
 	c->ticks += opcode.ticks;
 	opcode.function(c);
+#endif
 #ifdef NSG6502_DEBUG
+	nsg6502_flags_resolve(c);
 	NSG6502_DEBUG_PRINT("NSG6502: A: 0x%hhx X: 0x%hhx Y: 0x%hhx PC: 0x%hx SP: "
 						"0x%x STATUS: 0x%hhx\n",
 						c->a, c->x, c->y, c->pc - 1, 0x100 + c->sp, c->status);
 #endif
 }
 
+#ifdef NSG6502_FUSED
+#ifdef __cplusplus
+#error "superinstructions are only generated for struct nsg6502_cpu"
+#endif
+
+// Fetches the next instruction of a superinstruction. Returns 1 if it is
+// the expected one, which the caller then runs; anything else is run here
+// and ends the sequence. Nothing is fetched while an interrupt is pending,
+// that is left to the next nsg6502_opcode_execute.
+static int nsg6502_fused_fetch(struct nsg6502_cpu *c, uint8_t expected) {
+	if (c->nmi | c->irq) {
+		return 0;
+	}
+#ifdef NSG6502_65C02
+	if (c->halt) {
+		return 0;
+	}
+#endif
+	uint8_t opcode_byte = nsg6502_fetch_byte(c);
+	if (opcode_byte != expected) {
+		nsg6502_opcode_dispatch(c, opcode_byte);
+		return 0;
+	}
+	return 1;
+}
+
+// Output of nsg6502_fuse, e.g. -DNSG6502_FUSED='"fused.h"'
+#include NSG6502_FUSED
+#endif
+
+#ifdef NSG6502_65C02
+// Returns 1 once a CPU stopped by WAI has an interrupt line raised, asking
+// the host to wait for one first if it can
+static int nsg6502_wake(struct nsg6502_cpu *c) {
+	if (c->halt == NSG6502_HALT_STP) {
+		return 0;
+	}
+	if (!(c->nmi | c->irq) && c->wait_callback) {
+		c->wait_callback(c);
+	}
+	if (!(c->nmi | c->irq)) {
+		return 0;
+	}
+	c->halt = 0;
+	return 1;
+}
+#endif
+
+NSG6502_BUS_TEMPLATE
+void nsg6502_opcode_execute(NSG6502_BUS_CPU *c) {
+#ifdef NSG6502_65C02
+	if (c->halt && !nsg6502_wake(c)) {
+		c->ticks++;
+		return;
+	}
+#endif
+	if (c->nmi | c->irq) {
+		if (c->nmi) {
+			c->nmi = 0;
+			nsg6502_interrupt(c, 0xFFFA);
+			return;
+		}
+		if (!NSG6502_FLAG_IS_SET(c->status,
+								 NSG6502_STATUS_REGISTER_INTERRUPT_DISABLE)) {
+			nsg6502_interrupt(c, 0xFFFE);
+			return;
+		}
+	}
+
+	uint8_t opcode_byte = nsg6502_fetch_byte(c);
+#ifdef NSG6502_FUSED
+	if (NSG6502_FUSED_OPCODES[opcode_byte]) {
+		NSG6502_FUSED_OPCODES[opcode_byte](c);
+		return;
+	}
+#endif
+	nsg6502_opcode_dispatch(c, opcode_byte);
+}
+
 #endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// C++ front end with the bus as a template parameter.
+//
+// nsg6502::Cpu<Bus> is a struct nsg6502_cpu run by the handlers of
+// nsg6502.h, which C++ compiles as templates over the CPU type. Every
+// access goes through Bus::read() and Bus::write() of a concrete type, so
+// the compiler can inline the memory path of each system into the handlers
+// instead of calling through memory_read_callback and
+// memory_write_callback. They take the CPU first, like the callbacks.
+// Cpu<CallbackBus> is the C model of optional callbacks over memory.
+//
+// The NSG6502_* options apply as they do to the C core, except
+// NSG6502_FUSED. Traps get the CPU as a struct nsg6502_cpu.
+
+#ifndef NSG6502_HPP
+#define NSG6502_HPP
+
+#include "nsg6502.h"
+
+namespace nsg6502 {
+
+// memory, without callbacks
+struct MemoryBus {
+	uint8_t read(struct nsg6502_cpu *c, uint16_t addr) {
+		return c->memory[addr];
+	}
+	void write(struct nsg6502_cpu *c, uint16_t addr, uint8_t data) {
+		c->memory[addr] = data;
+	}
+};
+
+// memory_read_callback and memory_write_callback when set, memory
+// otherwise, as in C
+struct CallbackBus {
+	uint8_t read(struct nsg6502_cpu *c, uint16_t addr) {
+		return ::nsg6502_memory_read(c, addr);
+	}
+	void write(struct nsg6502_cpu *c, uint16_t addr, uint8_t data) {
+		::nsg6502_memory_write(c, addr, data);
+	}
+};
+
+template <class Bus> class Cpu : public nsg6502_cpu {
+  public:
+	Bus bus;
+
+	explicit Cpu(Bus b = Bus()) : nsg6502_cpu(), bus(b) {}
+
+	void reset() { nsg6502_reset(this); }
+
+	// Runs one instruction, or enters a pending interrupt
+	void step() { nsg6502_opcode_execute(this); }
+
+	// Runs until at least n more ticks have passed
+	void run(size_t n) {
+		size_t end = ticks + n;
+		while (ticks < end) {
+			nsg6502_opcode_execute(this);
+		}
+	}
+};
+
+// Found through the Cpu argument by nsg6502_read_byte and
+// nsg6502_write_byte, and preferred to the struct nsg6502_cpu versions
+template <class Bus>
+inline uint8_t nsg6502_memory_read(Cpu<Bus> *c, uint16_t addr) {
+	return c->bus.read(c, addr);
+}
+
+template <class Bus>
+inline void nsg6502_memory_write(Cpu<Bus> *c, uint16_t addr, uint8_t data) {
+	c->bus.write(c, addr, data);
+}
+
+} // namespace nsg6502
+
+#endif
@@ -0,0 +1,126 @@
+#define NSG6502_TABLE_ALU
+#include "nsg6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// usage: nsg6502_alu_check [operations]
+//
+// Compares the NSG6502_TABLE_ALU tables with nsg6502_adc_compute and
+// nsg6502_sbc_compute for all 2^18 combinations of D, C, A and operand,
+// with and without the other status bits set, then times the same mix of
+// ADC and SBC (1e8 operations by default) through both paths.
+
+static double check_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t check_op(const char *name, const uint16_t *table,
+					   void (*compute)(struct nsg6502_cpu *, uint8_t)) {
+	// Bits neither path may touch, and N/Z/V from an earlier result
+	const uint8_t others[] = {
+		0, NSG6502_STATUS_REGISTER_INTERRUPT_DISABLE |
+			   NSG6502_STATUS_REGISTER_BREAK | 0x20 |
+			   NSG6502_STATUS_REGISTER_OVERFLOW |
+			   NSG6502_STATUS_REGISTER_NEGATIVE |
+			   NSG6502_STATUS_REGISTER_ZERO};
+	size_t mismatches = 0;
+	for (size_t o = 0; o < sizeof(others); o++) {
+		for (size_t i = 0; i < (1 << 18); i++) {
+			uint8_t status =
+				others[o] |
+				((i >> 16) & 1 ? NSG6502_STATUS_REGISTER_CARRY : 0) |
+				((i >> 17) & 1 ? NSG6502_STATUS_REGISTER_DECIMAL : 0);
+			struct nsg6502_cpu want = {0};
+			want.a = (i >> 8) & 0xFF;
+			want.status = status;
+			struct nsg6502_cpu got = want;
+			compute(&want, i & 0xFF);
+			nsg6502_alu_apply(&got, table, i & 0xFF);
+			// Built with NSG6502_LAZY_FLAGS, both leave N and Z pending
+			nsg6502_flags_resolve(&want);
+			nsg6502_flags_resolve(&got);
+			if (want.a != got.a || want.status != got.status) {
+				if (!mismatches) {
+					fprintf(stderr,
+							"%s: P=%02X A=%02X #%02X: want A=%02X P=%02X, "
+							"got A=%02X P=%02X\n",
+							name, status, (unsigned)(i >> 8) & 0xFF,
+							(unsigned)i & 0xFF, want.a, want.status, got.a,
+							got.status);
+				}
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+// Same pseudo random operands, carries and decimal flags for both paths.
+// The result is folded into a sum so neither loop can be dropped.
+#define CHECK_INPUTS 65536
+static uint8_t check_operand[CHECK_INPUTS];
+static uint8_t check_flags[CHECK_INPUTS];
+
+static double check_time(int table, size_t operations, unsigned int *sum) {
+	struct nsg6502_cpu c = {0};
+	double start = check_now();
+	for (size_t i = 0; i < operations; i++) {
+		size_t n = i % CHECK_INPUTS;
+		uint8_t d = check_operand[n];
+		c.status = (c.status & ~NSG6502_STATUS_REGISTER_DECIMAL) |
+				   (check_flags[n] & NSG6502_STATUS_REGISTER_DECIMAL);
+		if (check_flags[n] & 1) {
+			if (table) {
+				nsg6502_alu_apply(&c, nsg6502_adc_table, d);
+			} else {
+				nsg6502_adc_compute(&c, d);
+			}
+		} else {
+			if (table) {
+				nsg6502_alu_apply(&c, nsg6502_sbc_table, d);
+			} else {
+				nsg6502_sbc_compute(&c, d);
+			}
+		}
+		*sum += c.a + c.status;
+	}
+	return check_now() - start;
+}
+
+int main(int argc, char **argv) {
+	size_t operations = argc > 1 ? strtoull(argv[1], NULL, 0) : 100000000;
+	nsg6502_alu_init();
+
+	size_t mismatches = 0;
+	for (int i = 0; i < 256; i++) {
+		uint8_t nz = (i & 0x80 ? NSG6502_STATUS_REGISTER_NEGATIVE : 0) |
+					 (i == 0 ? NSG6502_STATUS_REGISTER_ZERO : 0);
+		mismatches += nsg6502_nz_table[i] != nz;
+	}
+	mismatches += check_op("adc", nsg6502_adc_table, nsg6502_adc_compute);
+	mismatches += check_op("sbc", nsg6502_sbc_table, nsg6502_sbc_compute);
+	printf("mismatches=%zu\n", mismatches);
+
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < CHECK_INPUTS; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		check_operand[i] = x;
+		check_flags[i] = x >> 8 & 1;
+		// Decimal mode one time in eight
+		if ((x >> 9 & 7) == 0) {
+			check_flags[i] |= NSG6502_STATUS_REGISTER_DECIMAL;
+		}
+	}
+
+	unsigned int sum = 0;
+	double compute = check_time(0, operations, &sum);
+	double table = check_time(1, operations, &sum);
+	printf("operations=%zu compute=%.3fs table=%.3fs sum=%u\n", operations,
+		   compute, table, sum);
+	return mismatches != 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Many instances in one mapping.
+//
+// Every instance gets a control block holding its struct nsg6502_cpu
+// followed by state_size bytes for the host's devices, and 64 KiB of guest
+// memory. The control blocks come first, packed at cache line granularity,
+// so the hot state of neighbouring instances shares pages instead of each
+// dragging in one of its own. The whole arena is one anonymous mapping:
+// memory an instance never touches is never backed. The pages holding ROM
+// are mapped into every slot from one memfd, copy on write: all instances
+// read the same physical pages, and a guest that writes to its ROM gets a
+// private copy of just that page. Where memfd is not available ROM is
+// copied into each slot instead.
+//
+// NSG6502_ARENA_HUGE asks for transparent huge pages for the whole arena.
+// It pays off when instances use most of their RAM; the ROM pages are
+// still mapped at 4 KiB, which splits the huge pages they land in. Each
+// ROM mapping also costs the process a couple of VMAs, once
+// vm.max_map_count runs out the remaining instances fall back to copies.
+
+#ifndef NSG6502_ARENA_H
+#define NSG6502_ARENA_H
+
+#include "nsg6502.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NSG6502_ARENA_HUGE (1 << 0)
+
+#define NSG6502_ARENA_PAGE_SIZE 0x1000
+#define NSG6502_ARENA_ALIGN 64
+
+struct nsg6502_arena {
+	uint8_t *base;
+	size_t size;
+	size_t count;
+	size_t control_size;
+	uint8_t *memory;
+
+	int rom_fd;
+};
+
+static size_t nsg6502_arena_round(size_t n, size_t to) {
+	return (n + to - 1) / to * to;
+}
+
+static struct nsg6502_cpu *nsg6502_arena_cpu(struct nsg6502_arena *a,
+											 size_t i) {
+	return (struct nsg6502_cpu *)(a->base + i * a->control_size);
+}
+
+// The host's device state for instance i, cache line aligned
+static void *nsg6502_arena_state(struct nsg6502_arena *a, size_t i) {
+	return a->base + i * a->control_size +
+		   nsg6502_arena_round(sizeof(struct nsg6502_cpu),
+							   NSG6502_ARENA_ALIGN);
+}
+
+static void nsg6502_arena_destroy(struct nsg6502_arena *a) {
+	if (a->base) {
+		munmap(a->base, a->size);
+	}
+	if (a->rom_fd >= 0) {
+		close(a->rom_fd);
+	}
+	a->base = NULL;
+	a->rom_fd = -1;
+}
+
+// Sets up count instances. image is a 64 KiB template of which only
+// [rom_start, rom_start + rom_size) is used, widened to whole pages; the
+// rest of guest memory starts out zero. Each CPU comes back zeroed with
+// memory pointing into its slot, callbacks and reset are up to the host.
+static int nsg6502_arena_init(struct nsg6502_arena *a, size_t count,
+							  size_t state_size, const uint8_t *image,
+							  uint32_t rom_start, uint32_t rom_size,
+							  int flags) {
+	a->count = count;
+	a->control_size = nsg6502_arena_round(
+		nsg6502_arena_round(sizeof(struct nsg6502_cpu), NSG6502_ARENA_ALIGN) +
+			state_size,
+		NSG6502_ARENA_ALIGN);
+	size_t controls = nsg6502_arena_round(count * a->control_size,
+										  NSG6502_ARENA_PAGE_SIZE);
+	a->size = controls + count * 0x10000;
+	a->rom_fd = -1;
+	a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (a->base == MAP_FAILED) {
+		a->base = NULL;
+		return -1;
+	}
+	a->memory = a->base + controls;
+#ifdef MADV_HUGEPAGE
+	if (flags & NSG6502_ARENA_HUGE) {
+		madvise(a->base, a->size, MADV_HUGEPAGE);
+	}
+#endif
+
+	uint32_t first = rom_start & ~(NSG6502_ARENA_PAGE_SIZE - 1);
+	uint32_t end = nsg6502_arena_round(rom_start + rom_size,
+									   NSG6502_ARENA_PAGE_SIZE);
+	if (end > 0x10000) {
+		end = 0x10000;
+	}
+	size_t rom_pages = rom_size ? end - first : 0;
+
+#ifdef SYS_memfd_create
+	if (rom_pages) {
+		a->rom_fd = syscall(SYS_memfd_create, "nsg6502-rom", 0);
+		if (a->rom_fd >= 0 &&
+			(ftruncate(a->rom_fd, rom_pages) != 0 ||
+			 pwrite(a->rom_fd, image + first, rom_pages, 0) !=
+				 (ssize_t)rom_pages)) {
+			close(a->rom_fd);
+			a->rom_fd = -1;
+		}
+	}
+#endif
+
+	for (size_t i = 0; i < count; i++) {
+		struct nsg6502_cpu *c = nsg6502_arena_cpu(a, i);
+		c->memory = a->memory + i * 0x10000;
+		if (!rom_pages) {
+			continue;
+		}
+		if (a->rom_fd < 0 ||
+			mmap(c->memory + first, rom_pages, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_FIXED, a->rom_fd, 0) == MAP_FAILED) {
+			memcpy(c->memory + first, image + first, rom_pages);
+		}
+	}
+	return 0;
+}
+
+#endif
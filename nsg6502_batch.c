@@ -0,0 +1,329 @@
+#include "nsg6502.h"
+#include "nsg6502_fb.h"
+#include "nsg6502_profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// PC traps, BRK and the instruction limit are checked between calls to
+// nsg6502_opcode_execute, which may run several instructions when fused
+#ifdef NSG6502_FUSED
+#error "nsg6502_batch cannot be built with NSG6502_FUSED"
+#endif
+
+// usage: nsg6502_batch [options] <rom>
+//
+// Runs a ROM image without a terminal, for scripts and CI. The image is
+// loaded at -l (by default so that it ends at $FFFF) and started at -s (by
+// default through the reset vector). The run stops when the guest writes
+// to the exit port, on a BRK, when PC reaches one of the -t addresses, or
+// after -c ticks or -i instructions, whichever comes first. Built with
+// NSG6502_65C02, WAI and STP stop it too, as nothing here interrupts the
+// guest. Statistics and the final registers go to stderr as one line of
+// key=value pairs.
+//
+// With -f, a framebuffer of 8 bit RGB 3-3-2 pixels is captured every
+// BATCH_FRAME_TICKS ticks, and once more at the end, if it changed: as a
+// numbered PPM file per frame with -d, and into a shared frame for
+// nsg6502_fb_shared_read() with -m.
+//
+// Exit status: the byte written to the exit port, 0 at a PC trap, 2 when
+// a limit was reached, 3 on BRK, 4 on WAI or STP, 1 on errors.
+//
+//   -l addr   load address
+//   -s addr   start address
+//   -c ticks  tick limit
+//   -i count  instruction limit
+//   -e addr   exit port
+//   -o addr   output port, bytes written there go to stdout at the end
+//   -t addr   stop when PC gets here, can be given more than once
+//   -p file   write an opcode sequence profile for nsg6502_fuse
+//   -f addr:WxH  framebuffer at addr, W pixels wide and H high
+//   -d prefix frame dumps, written to <prefix>000000.ppm and on
+//   -m file   shared frame, e.g. in /dev/shm
+
+#define BATCH_MAX_OUTPUT (1 << 20)
+// 60 frames a second at 1 MHz
+#define BATCH_FRAME_TICKS 16667
+
+#define BATCH_STOP_EXIT 1
+#define BATCH_STOP_BRK 2
+#define BATCH_STOP_TRAP 3
+#define BATCH_STOP_LIMIT 4
+#define BATCH_STOP_WAI 5
+#define BATCH_STOP_STP 6
+
+static const char *const batch_reasons[] = {"", "exit", "brk", "trap",
+											"limit", "wai", "stp"};
+
+static uint8_t memory[0x10000];
+// Non-zero for the addresses given with -t
+static uint8_t traps[0x10000];
+
+static long batch_exit_port = -1;
+static long batch_output_port = -1;
+static int batch_stop;
+static uint8_t batch_exit_code;
+
+static struct nsg6502_profile batch_profile;
+
+static uint8_t batch_output[BATCH_MAX_OUTPUT];
+static size_t batch_output_size;
+
+static long batch_fb_start = -1;
+static struct nsg6502_fb batch_fb;
+static const char *batch_fb_prefix;
+static unsigned int batch_fb_frames;
+
+static void batch_write(struct nsg6502_cpu *c, uint16_t addr, uint8_t data) {
+	// The framebuffer's cells are memory, the device only marks tiles
+	if ((uint16_t)(addr - batch_fb_start) < nsg6502_fb_size(&batch_fb)) {
+		nsg6502_fb_write(&batch_fb, addr - batch_fb_start, data);
+		return;
+	}
+	if (addr == batch_exit_port) {
+		batch_stop = BATCH_STOP_EXIT;
+		batch_exit_code = data;
+	} else if (addr == batch_output_port) {
+		if (batch_output_size < BATCH_MAX_OUTPUT) {
+			batch_output[batch_output_size++] = data;
+		}
+	}
+	c->memory[addr] = data;
+}
+
+static long batch_number(const char *s, long max) {
+	char *end;
+	long n = strtol(s[0] == '$' ? s + 1 : s, &end, s[0] == '$' ? 16 : 0);
+	if (*s == '\0' || *end != '\0' || n < 0 || n > max) {
+		fprintf(stderr, "NSG6502: bad number %s\n", s);
+		exit(1);
+	}
+	return n;
+}
+
+// Publishes and dumps the framebuffer if anything changed
+static void batch_frame(void) {
+	if (!batch_fb.any_dirty) {
+		return;
+	}
+	if (batch_fb_prefix) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s%06u.ppm", batch_fb_prefix,
+				 batch_fb_frames);
+		FILE *f = fopen(path, "wb");
+		if (!f || nsg6502_fb_write_ppm(&batch_fb, f) != 0) {
+			fprintf(stderr, "NSG6502: cannot write %s\n", path);
+		}
+		if (f) {
+			fclose(f);
+		}
+	}
+	batch_fb_frames++;
+	nsg6502_fb_publish(&batch_fb);
+}
+
+static uint64_t batch_count(const char *s) {
+	char *end;
+	unsigned long long n = strtoull(s, &end, 0);
+	if (*s == '\0' || *s == '-' || *end != '\0') {
+		fprintf(stderr, "NSG6502: bad count %s\n", s);
+		exit(1);
+	}
+	return n;
+}
+
+int main(int argc, char **argv) {
+	long load = -1;
+	long start = -1;
+	uint64_t tick_limit = UINT64_MAX;
+	uint64_t instruction_limit = UINT64_MAX;
+	const char *profile = NULL;
+	const char *fb_spec = NULL;
+	const char *fb_shared = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "l:s:c:i:e:o:t:p:f:d:m:")) != -1) {
+		switch (opt) {
+			case 'l':
+				load = batch_number(optarg, 0xFFFF);
+				break;
+			case 's':
+				start = batch_number(optarg, 0xFFFF);
+				break;
+			case 'c':
+				tick_limit = batch_count(optarg);
+				break;
+			case 'i':
+				instruction_limit = batch_count(optarg);
+				break;
+			case 'e':
+				batch_exit_port = batch_number(optarg, 0xFFFF);
+				break;
+			case 'o':
+				batch_output_port = batch_number(optarg, 0xFFFF);
+				break;
+			case 't':
+				traps[batch_number(optarg, 0xFFFF)] = 1;
+				break;
+			case 'p':
+				profile = optarg;
+				break;
+			case 'f':
+				fb_spec = optarg;
+				break;
+			case 'd':
+				batch_fb_prefix = optarg;
+				break;
+			case 'm':
+				fb_shared = optarg;
+				break;
+			default:
+				fprintf(stderr,
+						"usage: %s [-l load] [-s start] [-c ticks] [-i "
+						"instructions] [-e exit port] [-o output port] [-t "
+						"trap]... [-p profile] [-f addr:WxH] [-d prefix] [-m "
+						"file] <rom>\n",
+						argv[0]);
+				return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [options] <rom>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		fprintf(stderr, "NSG6502: cannot open %s\n", argv[optind]);
+		return 1;
+	}
+	static uint8_t image[0x10001];
+	size_t size = fread(image, 1, sizeof(image), f);
+	fclose(f);
+	if (load < 0) {
+		load = 0x10000 - size;
+	}
+	if (size > 0x10000 || load + size > 0x10000) {
+		fprintf(stderr, "NSG6502: %s does not fit at $%04lX\n", argv[optind],
+				load < 0 ? 0 : load);
+		return 1;
+	}
+	memcpy(&memory[load], image, size);
+
+	if (fb_spec) {
+		char spec[64];
+		snprintf(spec, sizeof(spec), "%s", fb_spec);
+		char *geometry = strchr(spec, ':');
+		char *height = geometry ? strchr(geometry, 'x') : NULL;
+		if (!height) {
+			fprintf(stderr, "NSG6502: framebuffer has to be addr:WxH\n");
+			return 1;
+		}
+		*geometry++ = '\0';
+		*height++ = '\0';
+		batch_fb_start = batch_number(spec, 0xFFFF);
+		long w = batch_number(geometry, 0xFFFF);
+		long h = batch_number(height, 0xFFFF);
+		if (!w || !h || batch_fb_start + w * h > 0x10000) {
+			fprintf(stderr, "NSG6502: framebuffer does not fit\n");
+			return 1;
+		}
+		if (nsg6502_fb_init(&batch_fb, &memory[batch_fb_start], w, h,
+							NSG6502_FB_PIXELS) != 0) {
+			fprintf(stderr, "NSG6502: framebuffer needs more than %d tiles\n",
+					NSG6502_FB_MAX_TILES);
+			return 1;
+		}
+		if (fb_shared && nsg6502_fb_share(&batch_fb, fb_shared) != 0) {
+			fprintf(stderr, "NSG6502: cannot share %s\n", fb_shared);
+			return 1;
+		}
+	}
+
+	struct nsg6502_cpu cpu = {0};
+	cpu.memory = memory;
+	// The default bus path is the fast one, only hook writes for the ports
+	if (batch_exit_port >= 0 || batch_output_port >= 0 ||
+		batch_fb_start >= 0) {
+		cpu.memory_write_callback = batch_write;
+	}
+	nsg6502_reset(&cpu);
+	if (start >= 0) {
+		cpu.pc = start;
+	}
+
+	uint64_t instructions = 0;
+	size_t frame_due = BATCH_FRAME_TICKS;
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while (!batch_stop) {
+		if (traps[cpu.pc]) {
+			batch_stop = BATCH_STOP_TRAP;
+		} else if (memory[cpu.pc] == 0x00) {
+			batch_stop = BATCH_STOP_BRK;
+		} else if (cpu.ticks >= tick_limit ||
+				   instructions >= instruction_limit) {
+			batch_stop = BATCH_STOP_LIMIT;
+		} else {
+			if (profile) {
+				nsg6502_profile_step(&batch_profile, &cpu);
+			}
+			nsg6502_opcode_execute(&cpu);
+			instructions++;
+			if (batch_fb_start >= 0 && cpu.ticks >= frame_due) {
+				batch_frame();
+				frame_due = cpu.ticks + BATCH_FRAME_TICKS;
+			}
+#ifdef NSG6502_65C02
+			if (cpu.halt) {
+				batch_stop = cpu.halt == NSG6502_HALT_WAI ? BATCH_STOP_WAI
+														  : BATCH_STOP_STP;
+			}
+#endif
+		}
+	}
+	if (batch_fb_start >= 0) {
+		batch_frame();
+		nsg6502_fb_unshare(&batch_fb);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double seconds =
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	if (profile) {
+		FILE *pf = fopen(profile, "w");
+		if (!pf || nsg6502_profile_save(&batch_profile, pf) != 0) {
+			fprintf(stderr, "NSG6502: cannot write profile %s\n", profile);
+		}
+		if (pf) {
+			fclose(pf);
+		}
+	}
+
+	fwrite(batch_output, 1, batch_output_size, stdout);
+	fflush(stdout);
+	nsg6502_flags_resolve(&cpu);
+	fprintf(stderr,
+			"reason=%s ticks=%zu instructions=%llu seconds=%.6f mips=%.2f "
+			"a=%02X x=%02X y=%02X sp=%02X p=%02X pc=%04X\n",
+			batch_reasons[batch_stop], cpu.ticks,
+			(unsigned long long)instructions, seconds,
+			seconds > 0 ? instructions / seconds / 1e6 : 0, cpu.a, cpu.x,
+			cpu.y, cpu.sp, cpu.status, cpu.pc);
+
+	switch (batch_stop) {
+		case BATCH_STOP_EXIT:
+			return batch_exit_code;
+		case BATCH_STOP_TRAP:
+			return 0;
+		case BATCH_STOP_LIMIT:
+			return 2;
+		case BATCH_STOP_WAI:
+		case BATCH_STOP_STP:
+			return 4;
+		default:
+			return 3;
+	}
+}
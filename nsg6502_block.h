@@ -0,0 +1,190 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Block device with DMA.
+//
+// A host file, mapped with mmap, seen as 512 byte sectors. The guest sets
+// up a transfer and writes a command; the sectors are then copied between
+// the file and guest memory with one memcpy, the CPU is charged
+// ticks_per_sector for each as if the DMA engine had held it off the bus,
+// and the device raises its IRQ line. Reading the status register
+// acknowledges the interrupt.
+//
+// Registers, from the base the device is attached at:
+//   0-3   first sector, little endian
+//   4-5   guest address
+//   6     sector count, 0 means 256
+//   7     write: command, read: status
+//   8-11  size of the file in sectors, read only
+//
+// DMA goes straight to c->memory, past any devices mapped over it.
+
+#ifndef NSG6502_BLOCK_H
+#define NSG6502_BLOCK_H
+
+#include "nsg6502.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NSG6502_BLOCK_SECTOR_SIZE 512
+#define NSG6502_BLOCK_REGISTERS 12
+
+#define NSG6502_BLOCK_COMMAND_READ 1
+#define NSG6502_BLOCK_COMMAND_WRITE 2
+
+#define NSG6502_BLOCK_STATUS_DONE (1 << 0)
+#define NSG6502_BLOCK_STATUS_ERROR (1 << 6)
+
+struct nsg6502_block {
+	struct nsg6502_cpu *cpu;
+	// Bit of cpu->irq this device drives
+	uint8_t irq;
+	size_t ticks_per_sector;
+
+	uint8_t *data;
+	size_t size;
+	uint32_t sectors;
+	int writable;
+
+	uint32_t sector;
+	uint16_t addr;
+	uint8_t count;
+	uint8_t status;
+};
+
+// Maps path, read-write if possible. Returns 0 on success.
+static int nsg6502_block_open(struct nsg6502_block *b, struct nsg6502_cpu *c,
+							  const char *path, uint8_t irq) {
+	*b = (struct nsg6502_block){0};
+	b->cpu = c;
+	b->irq = irq;
+	// One tick per byte
+	b->ticks_per_sector = NSG6502_BLOCK_SECTOR_SIZE;
+
+	int fd = open(path, O_RDWR);
+	b->writable = fd >= 0;
+	if (fd < 0) {
+		fd = open(path, O_RDONLY);
+	}
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	b->size = st.st_size;
+	b->sectors = b->size / NSG6502_BLOCK_SECTOR_SIZE;
+	if (b->size) {
+		b->data = mmap(NULL, b->size,
+					   PROT_READ | (b->writable ? PROT_WRITE : 0), MAP_SHARED,
+					   fd, 0);
+	}
+	close(fd);
+	if (b->data == MAP_FAILED) {
+		b->data = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void nsg6502_block_close(struct nsg6502_block *b) {
+	if (b->data) {
+		munmap(b->data, b->size);
+	}
+	b->data = NULL;
+}
+
+static void nsg6502_block_command(struct nsg6502_block *b, uint8_t command) {
+	size_t count = b->count ? b->count : 256;
+	size_t bytes = count * NSG6502_BLOCK_SECTOR_SIZE;
+	b->status = NSG6502_BLOCK_STATUS_DONE;
+	if ((command != NSG6502_BLOCK_COMMAND_READ &&
+		 command != NSG6502_BLOCK_COMMAND_WRITE) ||
+		(size_t)b->sector + count > b->sectors ||
+		(size_t)b->addr + bytes > 0x10000 ||
+		(command == NSG6502_BLOCK_COMMAND_WRITE && !b->writable)) {
+		b->status |= NSG6502_BLOCK_STATUS_ERROR;
+	} else {
+		uint8_t *sectors =
+			b->data + (size_t)b->sector * NSG6502_BLOCK_SECTOR_SIZE;
+		uint8_t *memory = &b->cpu->memory[b->addr];
+		if (command == NSG6502_BLOCK_COMMAND_READ) {
+			memcpy(memory, sectors, bytes);
+		} else {
+			memcpy(sectors, memory, bytes);
+		}
+		b->cpu->ticks += count * b->ticks_per_sector;
+	}
+	b->cpu->irq |= b->irq;
+}
+
+static uint8_t nsg6502_block_read(void *data, uint16_t reg) {
+	struct nsg6502_block *b = data;
+	switch (reg) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+			return (b->sector >> (reg * 8)) & 0xFF;
+		case 4:
+		case 5:
+			return (b->addr >> ((reg - 4) * 8)) & 0xFF;
+		case 6:
+			return b->count;
+		case 7: {
+			uint8_t status = b->status;
+			b->status = 0;
+			b->cpu->irq &= ~b->irq;
+			return status;
+		}
+		case 8:
+		case 9:
+		case 10:
+		case 11:
+			return (b->sectors >> ((reg - 8) * 8)) & 0xFF;
+	}
+	return 0;
+}
+
+static void nsg6502_block_write(void *data, uint16_t reg, uint8_t value) {
+	struct nsg6502_block *b = data;
+	switch (reg) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+			b->sector &= ~(0xFFu << (reg * 8));
+			b->sector |= (uint32_t)value << (reg * 8);
+			break;
+		case 4:
+		case 5:
+			b->addr &= ~(0xFF << ((reg - 4) * 8));
+			b->addr |= value << ((reg - 4) * 8);
+			break;
+		case 6:
+			b->count = value;
+			break;
+		case 7:
+			nsg6502_block_command(b, value);
+			break;
+	}
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Flat memory with memory mapped devices.
+//
+// Devices claim an address range and get the offset into it on every
+// access. Pages (256 bytes) without a device never look at the device list,
+// so plain RAM costs one table lookup on top of the access itself.
+
+#ifndef NSG6502_BUS_H
+#define NSG6502_BUS_H
+
+#include "nsg6502.h"
+
+#define NSG6502_BUS_MAX_DEVICES 16
+
+struct nsg6502_bus_device {
+	uint16_t start;
+	uint16_t size;
+	uint8_t (*read)(void *, uint16_t);
+	void (*write)(void *, uint16_t, uint8_t);
+	void *data;
+};
+
+struct nsg6502_bus {
+	// Has to stay first, the bus callbacks get the bus from the CPU
+	struct nsg6502_cpu cpu;
+
+	struct nsg6502_bus_device devices[NSG6502_BUS_MAX_DEVICES];
+	size_t device_count;
+	// Non-zero for pages at least one device reaches into
+	uint8_t device_page[0x100];
+};
+
+static struct nsg6502_bus_device *
+nsg6502_bus_device_at(struct nsg6502_bus *b, uint16_t addr) {
+	for (size_t i = 0; i < b->device_count; i++) {
+		struct nsg6502_bus_device *d = &b->devices[i];
+		if ((uint16_t)(addr - d->start) < d->size) {
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static uint8_t nsg6502_bus_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_bus *b = (struct nsg6502_bus *)c;
+	if (b->device_page[addr >> 8]) {
+		struct nsg6502_bus_device *d = nsg6502_bus_device_at(b, addr);
+		if (d) {
+			return d->read ? d->read(d->data, addr - d->start) : 0;
+		}
+	}
+	return c->memory[addr];
+}
+
+static void nsg6502_bus_write(struct nsg6502_cpu *c, uint16_t addr,
+							  uint8_t data) {
+	struct nsg6502_bus *b = (struct nsg6502_bus *)c;
+	if (b->device_page[addr >> 8]) {
+		struct nsg6502_bus_device *d = nsg6502_bus_device_at(b, addr);
+		if (d) {
+			if (d->write) {
+				d->write(d->data, addr - d->start, data);
+			}
+			return;
+		}
+	}
+	c->memory[addr] = data;
+}
+
+// memory has to be 64 KiB
+static void nsg6502_bus_init(struct nsg6502_bus *b, uint8_t *memory) {
+	*b = (struct nsg6502_bus){0};
+	b->cpu.memory = memory;
+	b->cpu.memory_read_callback = nsg6502_bus_read;
+	b->cpu.memory_write_callback = nsg6502_bus_write;
+}
+
+// Maps a device at [start, start + size). Either callback may be NULL.
+// Returns -1 when the bus is full.
+static int nsg6502_bus_attach(struct nsg6502_bus *b, uint16_t start,
+							  uint16_t size, uint8_t (*read)(void *, uint16_t),
+							  void (*write)(void *, uint16_t, uint8_t),
+							  void *data) {
+	if (b->device_count == NSG6502_BUS_MAX_DEVICES || !size) {
+		return -1;
+	}
+	b->devices[b->device_count++] =
+		(struct nsg6502_bus_device){start, size, read, write, data};
+	for (uint32_t page = start >> 8; page <= (start + size - 1u) >> 8;
+		 page++) {
+		b->device_page[page & 0xFF] = 1;
+	}
+	return 0;
+}
+
+#endif
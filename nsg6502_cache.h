@@ -0,0 +1,260 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// On-disk cache of recompiled code.
+//
+// The code range is hashed page by page straight out of guest memory. The
+// hash of all pages, together with the range, the entry points, the core
+// options and the nsg6502.h and nsg6502_recomp.h it is built against,
+// names a shared object in the cache directory holding the nsg6502_recomp
+// output for exactly those bytes. On a hit the object is mapped back in
+// with dlopen and no analysis or compilation happens. On a miss it is
+// generated, built with $CC (cc by default) and renamed into place, so
+// concurrent processes racing on the same ROM never see a half written
+// file. A ROM that changes hashes differently and simply misses; code
+// changed while running is caught by the translation's own checks.
+
+#ifndef NSG6502_CACHE_H
+#define NSG6502_CACHE_H
+
+#include "nsg6502_recomp.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NSG6502_CACHE_PAGE_SIZE 0x100
+// Raise when what nsg6502_cache_build writes around the translation
+// changes
+#define NSG6502_CACHE_VERSION 2
+#define NSG6502_CACHE_MAX_ARGS 32
+
+// The shared object has to be built with the same core options as the host,
+// they change the layout of struct nsg6502_cpu and the opcode table
+static const char NSG6502_CACHE_CFLAGS[] = ""
+#ifdef NSG6502_TABLE_ALU
+										   " -DNSG6502_TABLE_ALU"
+#endif
+#ifdef NSG6502_LAZY_FLAGS
+										   " -DNSG6502_LAZY_FLAGS"
+#endif
+#ifdef NSG6502_65C02
+										   " -DNSG6502_65C02"
+#endif
+	;
+
+struct nsg6502_cache {
+	void *handle;
+	void (*run)(struct nsg6502_cpu *, size_t);
+};
+
+static uint64_t nsg6502_cache_fnv(uint64_t h, const uint8_t *data,
+								  size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		h = (h ^ data[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static uint64_t nsg6502_cache_hash(struct nsg6502_cpu *c, uint16_t start,
+								   uint32_t size) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (uint32_t off = 0; off < size; off += NSG6502_CACHE_PAGE_SIZE) {
+		uint32_t n = size - off < NSG6502_CACHE_PAGE_SIZE
+						 ? size - off
+						 : NSG6502_CACHE_PAGE_SIZE;
+		uint64_t page = nsg6502_cache_fnv(0xCBF29CE484222325ULL,
+										  &c->memory[start + off], n);
+		h = nsg6502_cache_fnv(h, (const uint8_t *)&page, sizeof(page));
+	}
+	return h;
+}
+
+// Folds in a header the shared object is compiled against, so an object
+// built from an older version of it is never mapped in. Returns -1 if it
+// cannot be read, the compiler would not find it either.
+static int nsg6502_cache_hash_source(uint64_t *h, const char *include_dir,
+									 const char *name) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", include_dir, name);
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return -1;
+	}
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		*h = nsg6502_cache_fnv(*h, buffer, n);
+	}
+	fclose(f);
+	return 0;
+}
+
+// Splits s in place at spaces and appends the words to argv
+static size_t nsg6502_cache_words(char *s, char **argv, size_t count) {
+	for (char *word = strtok(s, " "); word && count < NSG6502_CACHE_MAX_ARGS;
+		 word = strtok(NULL, " ")) {
+		argv[count++] = word;
+	}
+	return count;
+}
+
+// Runs the compiler without a shell, so nothing in the paths is ever
+// interpreted
+static int nsg6502_cache_compile(const char *include_dir, const char *out,
+								 const char *source) {
+	const char *cc = getenv("CC");
+	char compiler[1024];
+	char flags[sizeof(NSG6502_CACHE_CFLAGS)];
+	char include[4200];
+	snprintf(compiler, sizeof(compiler), "%s", cc && *cc ? cc : "cc");
+	memcpy(flags, NSG6502_CACHE_CFLAGS, sizeof(flags));
+	snprintf(include, sizeof(include), "-I%s", include_dir);
+
+	// $CC may carry a wrapper or options of its own, e.g. "ccache gcc"
+	char *argv[NSG6502_CACHE_MAX_ARGS + 1];
+	size_t n = nsg6502_cache_words(compiler, argv, 0);
+	if (n == 0 || n + 4 > NSG6502_CACHE_MAX_ARGS) {
+		return -1;
+	}
+	const char *fixed[] = {"-O2", "-w", "-shared", "-fPIC"};
+	for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+		argv[n++] = (char *)fixed[i];
+	}
+	n = nsg6502_cache_words(flags, argv, n);
+	if (n + 4 > NSG6502_CACHE_MAX_ARGS) {
+		return -1;
+	}
+	argv[n++] = include;
+	argv[n++] = "-o";
+	argv[n++] = (char *)out;
+	argv[n++] = (char *)source;
+	argv[n] = NULL;
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		return -1;
+	}
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int nsg6502_cache_build(const char *path, const char *dir,
+							   const char *include_dir, struct nsg6502_cpu *c,
+							   uint16_t start, uint32_t size,
+							   const uint16_t *entries, size_t entry_count) {
+	struct nsg6502_recomp *r = malloc(sizeof(*r));
+	if (!r) {
+		return -1;
+	}
+
+	char source[4096];
+	snprintf(source, sizeof(source), "%s/nsg6502-%d.c", dir, (int)getpid());
+	FILE *out = fopen(source, "w");
+	if (!out) {
+		free(r);
+		return -1;
+	}
+
+	nsg6502_recomp_analyze(r, &c->memory[start], start, size, entries,
+						   entry_count);
+	fprintf(out, "#include \"nsg6502.h\"\n\n");
+	nsg6502_recomp_emit(r, out, path);
+	fprintf(out, "\nvoid nsg6502_cache_entry(struct nsg6502_cpu *c, "
+				 "size_t budget) {\n"
+				 "#ifdef NSG6502_TABLE_ALU\n"
+				 "\tnsg6502_alu_init();\n"
+				 "#endif\n"
+				 "\tnsg6502_recomp_run(c, budget);\n}\n");
+	fclose(out);
+	free(r);
+
+	char tmp[4200];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	int ret = nsg6502_cache_compile(include_dir, tmp, source);
+	unlink(source);
+	if (ret != 0 || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+// Maps in the translation of [start, start + size), building it first if
+// the cache has none. include_dir is where nsg6502.h lives. Returns 0 on
+// success, after which cache->run can stand in for nsg6502_recomp_run.
+static int nsg6502_cache_open(struct nsg6502_cache *cache, const char *dir,
+							  const char *include_dir, struct nsg6502_cpu *c,
+							  uint16_t start, uint32_t size,
+							  const uint16_t *entries, size_t entry_count) {
+	uint64_t key = nsg6502_cache_hash(c, start, size);
+	key = nsg6502_cache_fnv(key, (const uint8_t *)&start, sizeof(start));
+	key = nsg6502_cache_fnv(key, (const uint8_t *)&size, sizeof(size));
+	key = nsg6502_cache_fnv(key, (const uint8_t *)entries,
+							entry_count * sizeof(*entries));
+	key = nsg6502_cache_fnv(key, (const uint8_t *)NSG6502_CACHE_CFLAGS,
+							sizeof(NSG6502_CACHE_CFLAGS));
+	uint32_t version[] = {NSG6502_CACHE_VERSION, sizeof(struct nsg6502_cpu)};
+	key = nsg6502_cache_fnv(key, (const uint8_t *)version, sizeof(version));
+	if (nsg6502_cache_hash_source(&key, include_dir, "nsg6502.h") != 0 ||
+		nsg6502_cache_hash_source(&key, include_dir, "nsg6502_recomp.h") !=
+			0) {
+		return -1;
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%016llx.so", dir,
+			 (unsigned long long)key);
+
+	if (access(path, R_OK) != 0 &&
+		nsg6502_cache_build(path, dir, include_dir, c, start, size, entries,
+							entry_count) != 0) {
+		return -1;
+	}
+
+	cache->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!cache->handle) {
+		return -1;
+	}
+	*(void **)&cache->run = dlsym(cache->handle, "nsg6502_cache_entry");
+	if (!cache->run) {
+		dlclose(cache->handle);
+		return -1;
+	}
+	return 0;
+}
+
+static void nsg6502_cache_close(struct nsg6502_cache *cache) {
+	if (cache->handle) {
+		dlclose(cache->handle);
+	}
+	cache->handle = NULL;
+	cache->run = NULL;
+}
+
+#endif
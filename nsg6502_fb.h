@@ -0,0 +1,397 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Framebuffer with dirty tracking.
+//
+// A width x height grid of one byte cells, either 8 bit pixels looked up in
+// a palette or the characters of a text screen. Every write through the
+// device marks the NSG6502_FB_TILE x NSG6502_FB_TILE tile it lands in, so
+// the host only looks at what changed: nsg6502_fb_collect() hands out the
+// dirty tiles as rectangles, and nsg6502_fb_publish() copies just those
+// into a frame in shared memory that other processes read with
+// nsg6502_fb_shared_read(). nsg6502_fb_write_ppm() and
+// nsg6502_fb_write_text() dump a whole frame.
+//
+// The cells can be the guest's own memory at the device's address, then
+// reads need no device callback.
+//
+// Registers, from the base the device is attached at: the cells, row by
+// row.
+
+#ifndef NSG6502_FB_H
+#define NSG6502_FB_H
+
+#include "nsg6502.h"
+#include "nsg6502_bus.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define NSG6502_FB_PIXELS 0
+#define NSG6502_FB_TEXT 1
+
+#define NSG6502_FB_TILE 8
+// Enough for a framebuffer covering the whole address space, but one only
+// a few cells wide or high can need more, nsg6502_fb_init() refuses those
+#define NSG6502_FB_MAX_TILES (0x10000 / (NSG6502_FB_TILE * NSG6502_FB_TILE))
+
+#define NSG6502_FB_MAGIC 0x4246534E // "NSFB"
+
+// In cells
+struct nsg6502_fb_rect {
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+	uint16_t height;
+};
+
+// A published frame. The data is RGB, 3 bytes per pixel, or the raw cells
+// of a text screen, row by row.
+struct nsg6502_fb_shared {
+	// Stored last, with release, once the header and a first frame are in
+	atomic_uint magic;
+	uint16_t width;
+	uint16_t height;
+	uint32_t mode;
+	// Odd while nsg6502_fb_publish() is copying
+	atomic_uint_fast64_t sequence;
+	// sequence after the publish that last changed each tile
+	atomic_uint_fast64_t tile_sequence[NSG6502_FB_MAX_TILES];
+	uint8_t data[];
+};
+
+struct nsg6502_fb {
+	uint8_t *cells;
+	uint16_t width;
+	uint16_t height;
+	int mode;
+	uint16_t tiles_x;
+	uint16_t tiles_y;
+	uint64_t dirty[NSG6502_FB_MAX_TILES / 64];
+	int any_dirty;
+	// 0xRRGGBB for every pixel value, RGB 3-3-2 unless the host changes it
+	uint32_t palette[256];
+
+	struct nsg6502_fb_shared *shared;
+	size_t shared_size;
+};
+
+// cells holds width * height bytes, which has to be at most 64 KiB.
+// Returns -1 for an empty screen, a bigger one or one with more than
+// NSG6502_FB_MAX_TILES tiles.
+static int nsg6502_fb_init(struct nsg6502_fb *fb, uint8_t *cells,
+						   uint16_t width, uint16_t height, int mode) {
+	uint32_t tiles_x = (width + NSG6502_FB_TILE - 1) / NSG6502_FB_TILE;
+	uint32_t tiles_y = (height + NSG6502_FB_TILE - 1) / NSG6502_FB_TILE;
+	if (!width || !height || (uint32_t)width * height > 0x10000 ||
+		tiles_x * tiles_y > NSG6502_FB_MAX_TILES) {
+		return -1;
+	}
+	*fb = (struct nsg6502_fb){0};
+	fb->cells = cells;
+	fb->width = width;
+	fb->height = height;
+	fb->mode = mode;
+	fb->tiles_x = tiles_x;
+	fb->tiles_y = tiles_y;
+	for (int i = 0; i < 256; i++) {
+		uint32_t r = (i >> 5) * 255 / 7;
+		uint32_t g = ((i >> 2) & 7) * 255 / 7;
+		uint32_t b = (i & 3) * 255 / 3;
+		fb->palette[i] = (r << 16) | (g << 8) | b;
+	}
+	// The first frame is all new
+	for (uint32_t t = 0; t < (uint32_t)fb->tiles_x * fb->tiles_y; t++) {
+		fb->dirty[t / 64] |= 1ull << (t % 64);
+	}
+	fb->any_dirty = 1;
+	return 0;
+}
+
+static size_t nsg6502_fb_size(struct nsg6502_fb *fb) {
+	return (size_t)fb->width * fb->height;
+}
+
+static void nsg6502_fb_mark(struct nsg6502_fb *fb, uint16_t reg) {
+	uint16_t x = reg % fb->width;
+	uint16_t y = reg / fb->width;
+	uint32_t t = (y / NSG6502_FB_TILE) * fb->tiles_x + x / NSG6502_FB_TILE;
+	fb->dirty[t / 64] |= 1ull << (t % 64);
+	fb->any_dirty = 1;
+}
+
+static uint8_t nsg6502_fb_read(void *data, uint16_t reg) {
+	struct nsg6502_fb *fb = data;
+	return reg < nsg6502_fb_size(fb) ? fb->cells[reg] : 0;
+}
+
+static void nsg6502_fb_write(void *data, uint16_t reg, uint8_t value) {
+	struct nsg6502_fb *fb = data;
+	if (reg >= nsg6502_fb_size(fb)) {
+		return;
+	}
+	// Writing what is already there changes nothing on screen
+	if (fb->cells[reg] != value) {
+		fb->cells[reg] = value;
+		nsg6502_fb_mark(fb, reg);
+	}
+}
+
+// Attaches fb, set up with nsg6502_fb_init(), at start
+static int nsg6502_fb_attach(struct nsg6502_fb *fb, struct nsg6502_bus *b,
+							 uint16_t start) {
+	return nsg6502_bus_attach(b, start, nsg6502_fb_size(fb), nsg6502_fb_read,
+							  nsg6502_fb_write, fb);
+}
+
+// Hands out the tiles written since the last call as at most max
+// rectangles and forgets them. Neighbouring tiles in a row make one
+// rectangle, and a rectangle grows down while the row below has the same
+// run; once max is reached the rest is merged into the last one. Returns
+// the number of rectangles, 0 when nothing changed.
+static size_t nsg6502_fb_collect(struct nsg6502_fb *fb,
+								 struct nsg6502_fb_rect *rects, size_t max) {
+	if (!fb->any_dirty || !max) {
+		return 0;
+	}
+	size_t count = 0;
+	for (uint16_t ty = 0; ty < fb->tiles_y; ty++) {
+		for (uint16_t tx = 0; tx < fb->tiles_x;) {
+			uint32_t t = (uint32_t)ty * fb->tiles_x + tx;
+			if (!(fb->dirty[t / 64] & (1ull << (t % 64)))) {
+				tx++;
+				continue;
+			}
+			uint16_t run = 0;
+			while (tx + run < fb->tiles_x &&
+				   (fb->dirty[(t + run) / 64] & (1ull << ((t + run) % 64)))) {
+				run++;
+			}
+			struct nsg6502_fb_rect r = {tx * NSG6502_FB_TILE,
+										ty * NSG6502_FB_TILE,
+										run * NSG6502_FB_TILE, NSG6502_FB_TILE};
+			tx += run;
+
+			int grown = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (rects[i].x == r.x && rects[i].width == r.width &&
+					rects[i].y + rects[i].height == r.y) {
+					rects[i].height += NSG6502_FB_TILE;
+					grown = 1;
+					break;
+				}
+			}
+			if (grown) {
+				continue;
+			}
+			if (count == max) {
+				// Out of room, cover this one with the last rectangle
+				struct nsg6502_fb_rect *last = &rects[max - 1];
+				uint16_t x1 = last->x + last->width > r.x + r.width
+								  ? last->x + last->width
+								  : r.x + r.width;
+				uint16_t y1 = r.y + r.height;
+				last->x = last->x < r.x ? last->x : r.x;
+				last->width = x1 - last->x;
+				last->height = y1 - last->y;
+				continue;
+			}
+			rects[count++] = r;
+		}
+	}
+	// Tiles at the right and bottom edges may be partly outside
+	for (size_t i = 0; i < count; i++) {
+		if (rects[i].x + rects[i].width > fb->width) {
+			rects[i].width = fb->width - rects[i].x;
+		}
+		if (rects[i].y + rects[i].height > fb->height) {
+			rects[i].height = fb->height - rects[i].y;
+		}
+	}
+	memset(fb->dirty, 0, sizeof(fb->dirty));
+	fb->any_dirty = 0;
+	return count;
+}
+
+static size_t nsg6502_fb_shared_data_size(uint16_t width, uint16_t height,
+										  int mode) {
+	return (size_t)width * height * (mode == NSG6502_FB_PIXELS ? 3 : 1);
+}
+
+// Copies a rectangle of cells into a frame laid out like the shared data
+static void nsg6502_fb_render(struct nsg6502_fb *fb, uint8_t *frame,
+							  struct nsg6502_fb_rect r) {
+	for (uint16_t y = r.y; y < r.y + r.height; y++) {
+		const uint8_t *src = &fb->cells[(size_t)y * fb->width + r.x];
+		if (fb->mode != NSG6502_FB_PIXELS) {
+			memcpy(&frame[(size_t)y * fb->width + r.x], src, r.width);
+			continue;
+		}
+		uint8_t *dst = &frame[((size_t)y * fb->width + r.x) * 3];
+		for (uint16_t x = 0; x < r.width; x++) {
+			uint32_t rgb = fb->palette[src[x]];
+			dst[x * 3] = rgb >> 16;
+			dst[x * 3 + 1] = rgb >> 8;
+			dst[x * 3 + 2] = rgb;
+		}
+	}
+}
+
+// Publishes the changes since the last call, or everything the first time.
+// Returns the number of rectangles copied. Without a shared frame the
+// changes are only forgotten.
+static size_t nsg6502_fb_publish(struct nsg6502_fb *fb) {
+	struct nsg6502_fb_shared *s = fb->shared;
+	struct nsg6502_fb_rect rects[64];
+	size_t count = nsg6502_fb_collect(fb, rects, 64);
+	if (!s || !count) {
+		return count;
+	}
+
+	uint64_t sequence =
+		atomic_load_explicit(&s->sequence, memory_order_relaxed);
+	atomic_store_explicit(&s->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (size_t i = 0; i < count; i++) {
+		nsg6502_fb_render(fb, s->data, rects[i]);
+		for (uint16_t ty = rects[i].y / NSG6502_FB_TILE;
+			 ty * NSG6502_FB_TILE < rects[i].y + rects[i].height; ty++) {
+			for (uint16_t tx = rects[i].x / NSG6502_FB_TILE;
+				 tx * NSG6502_FB_TILE < rects[i].x + rects[i].width; tx++) {
+				atomic_store_explicit(
+					&s->tile_sequence[(uint32_t)ty * fb->tiles_x + tx],
+					sequence + 2, memory_order_relaxed);
+			}
+		}
+	}
+	atomic_store_explicit(&s->sequence, sequence + 2, memory_order_release);
+	return count;
+}
+
+// Maps path, creating or resizing it, as the shared frame and publishes
+// the whole screen into it
+static int nsg6502_fb_share(struct nsg6502_fb *fb, const char *path) {
+	size_t size = sizeof(struct nsg6502_fb_shared) +
+				  nsg6502_fb_shared_data_size(fb->width, fb->height, fb->mode);
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	struct nsg6502_fb_shared *s = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (s == MAP_FAILED) {
+		return -1;
+	}
+	atomic_store_explicit(&s->magic, 0, memory_order_relaxed);
+	s->width = fb->width;
+	s->height = fb->height;
+	s->mode = fb->mode;
+	atomic_store_explicit(&s->sequence, 0, memory_order_relaxed);
+	fb->shared = s;
+	fb->shared_size = size;
+
+	for (uint32_t t = 0; t < (uint32_t)fb->tiles_x * fb->tiles_y; t++) {
+		fb->dirty[t / 64] |= 1ull << (t % 64);
+	}
+	fb->any_dirty = 1;
+	nsg6502_fb_publish(fb);
+	atomic_store_explicit(&s->magic, NSG6502_FB_MAGIC, memory_order_release);
+	return 0;
+}
+
+static void nsg6502_fb_unshare(struct nsg6502_fb *fb) {
+	if (fb->shared) {
+		munmap(fb->shared, fb->shared_size);
+		fb->shared = NULL;
+	}
+}
+
+// Reader side: copies the tiles changed after *since into frame, a buffer
+// of nsg6502_fb_shared_data_size() bytes, and moves *since up. Returns -1
+// when a publish got in the way; frame then holds a mix and the call
+// should simply be repeated.
+static int nsg6502_fb_shared_read(const struct nsg6502_fb_shared *s,
+								  uint8_t *frame, uint64_t *since) {
+	struct nsg6502_fb_shared *m = (struct nsg6502_fb_shared *)s;
+	uint64_t sequence =
+		atomic_load_explicit(&m->sequence, memory_order_acquire);
+	if (sequence & 1) {
+		return -1;
+	}
+	if (sequence == *since) {
+		return 0;
+	}
+	size_t bytes = m->mode == NSG6502_FB_PIXELS ? 3 : 1;
+	uint16_t tiles_x = (m->width + NSG6502_FB_TILE - 1) / NSG6502_FB_TILE;
+	uint16_t tiles_y = (m->height + NSG6502_FB_TILE - 1) / NSG6502_FB_TILE;
+	for (uint16_t ty = 0; ty < tiles_y; ty++) {
+		for (uint16_t tx = 0; tx < tiles_x; tx++) {
+			if (atomic_load_explicit(&m->tile_sequence[ty * tiles_x + tx],
+									 memory_order_relaxed) <= *since) {
+				continue;
+			}
+			uint16_t x = tx * NSG6502_FB_TILE;
+			uint16_t width = m->width - x < NSG6502_FB_TILE ? m->width - x
+															: NSG6502_FB_TILE;
+			for (uint16_t y = ty * NSG6502_FB_TILE;
+				 y < m->height && y < (ty + 1) * NSG6502_FB_TILE; y++) {
+				size_t at = ((size_t)y * m->width + x) * bytes;
+				memcpy(&frame[at], &m->data[at], width * bytes);
+			}
+		}
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&m->sequence, memory_order_relaxed) != sequence) {
+		return -1;
+	}
+	*since = sequence;
+	return 0;
+}
+
+// Writes the whole screen as a binary PPM, pixel framebuffers only
+static int nsg6502_fb_write_ppm(struct nsg6502_fb *fb, FILE *f) {
+	if (fb->mode != NSG6502_FB_PIXELS) {
+		return -1;
+	}
+	fprintf(f, "P6\n%u %u\n255\n", fb->width, fb->height);
+	for (size_t i = 0; i < nsg6502_fb_size(fb); i++) {
+		uint32_t rgb = fb->palette[fb->cells[i]];
+		uint8_t pixel[3] = {rgb >> 16, rgb >> 8, rgb};
+		fwrite(pixel, 3, 1, f);
+	}
+	return ferror(f) ? -1 : 0;
+}
+
+// Writes a text screen as lines of text, bytes outside printable ASCII
+// become spaces and bit 7 is ignored, as on the Apple 1
+static int nsg6502_fb_write_text(struct nsg6502_fb *fb, FILE *f) {
+	for (uint16_t y = 0; y < fb->height; y++) {
+		for (uint16_t x = 0; x < fb->width; x++) {
+			uint8_t ch = fb->cells[(size_t)y * fb->width + x] & 0x7F;
+			fputc(ch >= ' ' && ch < 0x7F ? ch : ' ', f);
+		}
+		fputc('\n', f);
+	}
+	return ferror(f) ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "nsg6502_profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// usage: nsg6502_fuse <profile>... > fused.h
+//
+// Picks superinstructions from profiles written by nsg6502_profile.h: for
+// every opcode, the one that most often follows it, and the one after that
+// too when the triple makes up at least half of the pair's runs. Only pairs
+// with at least FUSE_MIN_SHARE of all instructions are used. The output is
+// meant for -DNSG6502_FUSED='"fused.h"'.
+
+#define FUSE_MIN_SHARE 0.002
+
+static struct nsg6502_profile profile;
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <profile>...\n", argv[0]);
+		return 1;
+	}
+	for (int i = 1; i < argc; i++) {
+		FILE *f = fopen(argv[i], "r");
+		if (!f) {
+			perror(argv[i]);
+			return 1;
+		}
+		if (nsg6502_profile_load(&profile, f) != 0) {
+			fprintf(stderr, "%s: not a profile\n", argv[i]);
+			return 1;
+		}
+		fclose(f);
+	}
+
+	// The sequence chosen for every first opcode, 0 for none
+	int length[256] = {0};
+	uint8_t next[256][2];
+	uint64_t covered = 0;
+	for (int a = 0; a < 256; a++) {
+		if (!NSG6502_OPCODES[a].function) {
+			continue;
+		}
+		int b = -1;
+		for (int i = 0; i < 256; i++) {
+			if (NSG6502_OPCODES[i].function && profile.pairs[(a << 8) | i] &&
+				(b < 0 || profile.pairs[(a << 8) | i] >
+							  profile.pairs[(a << 8) | b])) {
+				b = i;
+			}
+		}
+		if (b < 0 || profile.pairs[(a << 8) | b] <
+						 profile.instructions * FUSE_MIN_SHARE) {
+			continue;
+		}
+		length[a] = 2;
+		next[a][0] = b;
+		covered += profile.pairs[(a << 8) | b];
+
+		int c = -1;
+		uint64_t best = 0;
+		for (int i = 0; i < 256; i++) {
+			uint64_t n = nsg6502_profile_triple(&profile,
+												(a << 16) | (b << 8) | i);
+			if (NSG6502_OPCODES[i].function && n > best) {
+				c = i;
+				best = n;
+			}
+		}
+		if (c >= 0 && best * 2 >= profile.pairs[(a << 8) | b]) {
+			length[a] = 3;
+			next[a][1] = c;
+		}
+	}
+
+	printf("// Generated by nsg6502_fuse from %llu profiled instructions, of "
+		   "which\n// %llu start a fused pair\n\n",
+		   (unsigned long long)profile.instructions,
+		   (unsigned long long)covered);
+	for (int a = 0; a < 256; a++) {
+		if (!length[a]) {
+			continue;
+		}
+		printf("// %s", NSG6502_OPCODES[a].name);
+		for (int i = 0; i < length[a] - 1; i++) {
+			printf(", %s", NSG6502_OPCODES[next[a][i]].name);
+		}
+		printf("\nstatic void nsg6502_fused_%02X(struct nsg6502_cpu *c) {\n",
+			   a);
+		// Opcodes are constants, so every dispatch becomes a direct call
+		printf("\tnsg6502_opcode_dispatch(c, 0x%02X);\n", a);
+		for (int i = 0; i < length[a] - 1; i++) {
+			printf("%.*sif (nsg6502_fused_fetch(c, 0x%02X)) {\n", i + 1,
+				   "\t\t\t", next[a][i]);
+			printf("%.*snsg6502_opcode_dispatch(c, 0x%02X);\n", i + 2,
+				   "\t\t\t", next[a][i]);
+		}
+		for (int i = length[a] - 2; i >= 0; i--) {
+			printf("%.*s}\n", i + 1, "\t\t\t");
+		}
+		printf("}\n\n");
+	}
+	printf("static void (*const NSG6502_FUSED_OPCODES[256])(struct nsg6502_cpu "
+		   "*) = {\n");
+	for (int a = 0; a < 256; a++) {
+		if (length[a]) {
+			printf("\t[0x%02X] = nsg6502_fused_%02X,\n", a, a);
+		}
+	}
+	if (!covered) {
+		printf("\t0,\n");
+	}
+	printf("};\n");
+	return 0;
+}
@@ -0,0 +1,234 @@
+#include "nsg6502_fuzz.h"
+#include "wozmon.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// usage: nsg6502_fuzz <iterations> [corpus dir]
+//
+// Coverage guided fuzzing of wozmon's command line parser. Inputs that
+// reach new edges are kept, and written to the corpus directory if one is
+// given. Files already in there are used as seeds. A run that jumps out of
+// the ROM (the R command) is cut short, what it would execute is not
+// wozmon.
+
+#define FUZZ_MAX_INPUT 64
+#define FUZZ_MAX_TICKS 20000
+#define FUZZ_MAX_CORPUS 4096
+
+struct fuzz_input {
+	uint8_t data[FUZZ_MAX_INPUT];
+	size_t size;
+};
+
+static struct nsg6502_fuzz fuzz;
+static uint8_t memory[0x10000];
+static uint8_t map[NSG6502_FUZZ_MAP_SIZE];
+// Hit count buckets seen so far for every edge
+static uint8_t seen[NSG6502_FUZZ_MAP_SIZE];
+
+static struct fuzz_input corpus[FUZZ_MAX_CORPUS];
+static size_t corpus_count;
+
+static const char *const fuzz_seeds[] = {
+	"FF00\r", "FF00.FF0F\r", "300: A9 41 8D 00 02\r", "FF00 FF08 FF10\r",
+	"300: 4C 00 FF\r300R\r", "3..4\r",
+};
+
+static const char fuzz_tokens[] = "0123456789ABCDEF.:R \r\x1b_";
+
+static uint64_t fuzz_rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t fuzz_rand(uint32_t n) {
+	fuzz_rng_state ^= fuzz_rng_state << 13;
+	fuzz_rng_state ^= fuzz_rng_state >> 7;
+	fuzz_rng_state ^= fuzz_rng_state << 17;
+	return (fuzz_rng_state >> 32) % n;
+}
+
+// AFL's hit count buckets
+static uint8_t fuzz_bucket(uint8_t n) {
+	if (n <= 3) {
+		return n == 3 ? 4 : n;
+	}
+	return n < 8 ? 8 : n < 16 ? 16 : n < 32 ? 32 : n < 128 ? 64 : 128;
+}
+
+// Folds map into seen and clears it. Returns whether anything was new.
+static int fuzz_novel(void) {
+	int novel = 0;
+	uint64_t *words = (uint64_t *)map;
+	for (size_t i = 0; i < NSG6502_FUZZ_MAP_SIZE / 8; i++) {
+		if (!words[i]) {
+			continue;
+		}
+		for (size_t j = i * 8; j < i * 8 + 8; j++) {
+			uint8_t b = fuzz_bucket(map[j]);
+			if (b & ~seen[j]) {
+				seen[j] |= b;
+				novel = 1;
+			}
+		}
+		words[i] = 0;
+	}
+	return novel;
+}
+
+static size_t fuzz_edges(void) {
+	size_t n = 0;
+	for (size_t i = 0; i < NSG6502_FUZZ_MAP_SIZE; i++) {
+		n += seen[i] != 0;
+	}
+	return n;
+}
+
+static void fuzz_mutate(struct fuzz_input *in) {
+	int rounds = 1 + fuzz_rand(4);
+	for (int r = 0; r < rounds; r++) {
+		size_t pos = in->size ? fuzz_rand(in->size) : 0;
+		switch (fuzz_rand(6)) {
+			case 0: // flip a bit
+				if (in->size) {
+					in->data[pos] ^= 1 << fuzz_rand(8);
+				}
+				break;
+			case 1: // random byte
+				if (in->size) {
+					in->data[pos] = fuzz_rand(256);
+				}
+				break;
+			case 2: // replace with a token
+				if (in->size) {
+					in->data[pos] =
+						fuzz_tokens[fuzz_rand(sizeof(fuzz_tokens) - 1)];
+				}
+				break;
+			case 3: // insert a token
+				if (in->size < FUZZ_MAX_INPUT) {
+					memmove(&in->data[pos + 1], &in->data[pos], in->size - pos);
+					in->data[pos] =
+						fuzz_tokens[fuzz_rand(sizeof(fuzz_tokens) - 1)];
+					in->size++;
+				}
+				break;
+			case 4: // delete a byte
+				if (in->size > 1) {
+					memmove(&in->data[pos], &in->data[pos + 1],
+							in->size - pos - 1);
+					in->size--;
+				}
+				break;
+			case 5: { // splice the tail of another input
+				struct fuzz_input *other = &corpus[fuzz_rand(corpus_count)];
+				size_t from = other->size ? fuzz_rand(other->size) : 0;
+				size_t n = other->size - from;
+				if (pos + n > FUZZ_MAX_INPUT) {
+					n = FUZZ_MAX_INPUT - pos;
+				}
+				memcpy(&in->data[pos], &other->data[from], n);
+				in->size = pos + n;
+				break;
+			}
+		}
+	}
+}
+
+static void fuzz_keep(const struct fuzz_input *in, const char *dir) {
+	if (corpus_count == FUZZ_MAX_CORPUS) {
+		return;
+	}
+	corpus[corpus_count++] = *in;
+	if (dir) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/id-%06zu", dir, corpus_count);
+		FILE *f = fopen(path, "wb");
+		if (f) {
+			fwrite(in->data, 1, in->size, f);
+			fclose(f);
+		}
+	}
+}
+
+static void fuzz_load(const char *dir) {
+	DIR *d = opendir(dir);
+	if (!d) {
+		return;
+	}
+	struct dirent *e;
+	while ((e = readdir(d)) && corpus_count < FUZZ_MAX_CORPUS) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		FILE *f = fopen(path, "rb");
+		if (!f) {
+			continue;
+		}
+		struct fuzz_input *in = &corpus[corpus_count];
+		in->size = fread(in->data, 1, FUZZ_MAX_INPUT, f);
+		fclose(f);
+		if (in->size) {
+			corpus_count++;
+		}
+	}
+	closedir(d);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <iterations> [corpus dir]\n", argv[0]);
+		return 1;
+	}
+	size_t iterations = strtoull(argv[1], NULL, 10);
+	const char *dir = argc > 2 ? argv[2] : NULL;
+
+	memcpy(&memory[0xFF00], wozmon, wozmon_len);
+	memory[0xFFFC] = 0x00;
+	memory[0xFFFD] = 0xFF;
+	if (nsg6502_fuzz_boot(&fuzz, memory, map, 1, FUZZ_MAX_TICKS) != 0) {
+		fprintf(stderr, "NSG6502: guest never asked for input\n");
+		return 1;
+	}
+	fuzz.code_start = 0xFF00;
+	fuzz.code_size = wozmon_len;
+	fuzz_novel();
+
+	if (dir) {
+		fuzz_load(dir);
+	}
+	size_t loaded = corpus_count;
+	for (size_t i = 0; i < sizeof(fuzz_seeds) / sizeof(*fuzz_seeds); i++) {
+		struct fuzz_input in = {{0}, strlen(fuzz_seeds[i])};
+		memcpy(in.data, fuzz_seeds[i], in.size);
+		nsg6502_fuzz_run(&fuzz, in.data, in.size, FUZZ_MAX_TICKS);
+		if (fuzz_novel()) {
+			fuzz_keep(&in, dir);
+		}
+	}
+	for (size_t i = 0; i < loaded; i++) {
+		nsg6502_fuzz_run(&fuzz, corpus[i].data, corpus[i].size,
+						 FUZZ_MAX_TICKS);
+		fuzz_novel();
+	}
+
+	size_t hangs = 0;
+	size_t escapes = 0;
+	clock_t start = clock();
+	for (size_t i = 0; i < iterations; i++) {
+		struct fuzz_input in = corpus[fuzz_rand(corpus_count)];
+		fuzz_mutate(&in);
+		int ret = nsg6502_fuzz_run(&fuzz, in.data, in.size, FUZZ_MAX_TICKS);
+		hangs += ret == NSG6502_FUZZ_HANG;
+		escapes += ret == NSG6502_FUZZ_ESCAPE;
+		if (fuzz_novel()) {
+			fuzz_keep(&in, dir);
+		}
+	}
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%zu execs in %.2fs (%.0f/s), %zu edges, corpus %zu, hangs %zu, "
+		   "escapes %zu\n",
+		   iterations, seconds, iterations / seconds, fuzz_edges(),
+		   corpus_count, hangs, escapes);
+	return 0;
+}
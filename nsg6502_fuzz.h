@@ -0,0 +1,162 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Persistent fuzzing target.
+//
+// The guest is booted once, up to the point where it first asks the console
+// for input, and snapshotted there. Every run then starts from that
+// snapshot: only the pages written by the previous run are copied back, the
+// registers and the random device are reset, and the input is fed through
+// the console registers main.c uses ($0202 status, $0201 data). A run ends
+// when the guest wants more input than it was given, after max_ticks, or
+// when the PC leaves [code_start, code_start + code_size), which by default
+// covers all of memory.
+//
+// Edge coverage is counted AFL style in map: every executed instruction
+// bumps map[pc ^ (prev_pc >> 1)], so map has to hold
+// NSG6502_FUZZ_MAP_SIZE counters. It can live in shared memory.
+
+#ifndef NSG6502_FUZZ_H
+#define NSG6502_FUZZ_H
+
+#include "nsg6502.h"
+#include "nsg6502_rng.h"
+#include "nsg6502_snapshot.h"
+
+#define NSG6502_FUZZ_MAP_SIZE 0x10000
+
+#define NSG6502_FUZZ_DONE 0
+#define NSG6502_FUZZ_HANG 1
+#define NSG6502_FUZZ_ESCAPE 2
+
+struct nsg6502_fuzz {
+	// Has to stay first, the bus callbacks get the target from the CPU
+	struct nsg6502_cpu cpu;
+
+	uint8_t *map;
+
+	uint16_t code_start;
+	uint32_t code_size;
+
+	const uint8_t *input;
+	size_t size;
+	size_t pos;
+	// The guest read the console with no input left
+	int starved;
+
+	struct nsg6502_rng rng;
+	struct nsg6502_snapshot boot;
+
+	uint8_t dirty[0x100];
+	uint8_t dirty_pages[0x100];
+	size_t dirty_count;
+};
+
+static uint8_t nsg6502_fuzz_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_fuzz *f = (struct nsg6502_fuzz *)c;
+	if (addr == 0xFE) {
+		return nsg6502_rng_byte(&f->rng);
+	} else if (addr == 0x0202 || addr == 0x0201) {
+		if (f->pos >= f->size) {
+			f->starved = 1;
+			return 0;
+		}
+		return addr == 0x0202 ? 1 : f->input[f->pos++];
+	}
+	return c->memory[addr];
+}
+
+static void nsg6502_fuzz_write(struct nsg6502_cpu *c, uint16_t addr,
+							   uint8_t data) {
+	struct nsg6502_fuzz *f = (struct nsg6502_fuzz *)c;
+	uint8_t page = addr >> 8;
+	if (!f->dirty[page]) {
+		f->dirty[page] = 1;
+		f->dirty_pages[f->dirty_count++] = page;
+	}
+	c->memory[addr] = data;
+}
+
+// memory has to be 64 KiB and already hold the program and its vectors.
+// Runs the guest from reset until it first waits for input, at most
+// max_ticks. Returns 0 if it got there.
+static int nsg6502_fuzz_boot(struct nsg6502_fuzz *f, uint8_t *memory,
+							 uint8_t *map, uint64_t seed, size_t max_ticks) {
+	f->cpu = (struct nsg6502_cpu){0};
+	f->cpu.memory = memory;
+	f->cpu.memory_read_callback = nsg6502_fuzz_read;
+	f->cpu.memory_write_callback = nsg6502_fuzz_write;
+	f->map = map;
+	f->code_start = 0;
+	f->code_size = 0x10000;
+	f->input = NULL;
+	f->size = f->pos = 0;
+	f->starved = 0;
+	nsg6502_rng_seed(&f->rng, seed);
+
+	nsg6502_reset(&f->cpu);
+	while (f->cpu.ticks < max_ticks) {
+		struct nsg6502_cpu saved = f->cpu;
+		nsg6502_opcode_execute(&f->cpu);
+		if (f->starved) {
+			// Boot ends in front of the first console read
+			f->cpu = saved;
+			memset(f->dirty, 0, sizeof(f->dirty));
+			f->dirty_count = 0;
+			return nsg6502_snapshot_save(&f->boot, &f->cpu, &f->rng);
+		}
+	}
+	return -1;
+}
+
+// Puts the machine back to where boot left it
+static void nsg6502_fuzz_restore(struct nsg6502_fuzz *f) {
+	for (size_t i = 0; i < f->dirty_count; i++) {
+		uint8_t page = f->dirty_pages[i];
+		memcpy(&f->cpu.memory[page << 8], &f->boot.memory[page << 8], 0x100);
+		f->dirty[page] = 0;
+	}
+	f->dirty_count = 0;
+	nsg6502_snapshot_restore_registers(&f->boot, &f->cpu, &f->rng);
+}
+
+static int nsg6502_fuzz_run(struct nsg6502_fuzz *f, const uint8_t *data,
+							size_t size, size_t max_ticks) {
+	struct nsg6502_cpu *c = &f->cpu;
+	nsg6502_fuzz_restore(f);
+	f->input = data;
+	f->size = size;
+	f->pos = 0;
+	f->starved = 0;
+
+	size_t limit = c->ticks + max_ticks;
+	uint8_t *map = f->map;
+	uint16_t prev = 0;
+	while (!f->starved) {
+		if (c->ticks >= limit) {
+			return NSG6502_FUZZ_HANG;
+		}
+		if ((uint16_t)(c->pc - f->code_start) >= f->code_size) {
+			return NSG6502_FUZZ_ESCAPE;
+		}
+		map[c->pc ^ prev]++;
+		prev = c->pc >> 1;
+		nsg6502_opcode_execute(c);
+	}
+	return NSG6502_FUZZ_DONE;
+}
+
+#endif
@@ -0,0 +1,676 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// GDB remote serial protocol stub.
+//
+// nsg6502_gdb_listen() opens a TCP ("host:port", loopback addresses only)
+// or Unix socket, and the host then runs the CPU through nsg6502_gdb_run()
+// instead of calling nsg6502_opcode_execute() itself. A client connecting
+// stops the CPU, and nsg6502_gdb_run() serves it until it resumes; Ctrl-C
+// stops the CPU again. Supported are register and memory reads and writes,
+// step, continue, software and hardware breakpoints (both the same here)
+// and write, read and access watchpoints.
+//
+// Breakpoints are bits in a 64 Kbit map indexed by PC, watchpoints are
+// flags on the pages they cover. As long as neither is set the CPU runs
+// the same loop as without the stub, and the socket is checked every
+// NSG6502_GDB_POLL_TICKS ticks however often the host calls
+// nsg6502_gdb_run(). Only with breakpoints set is the map tested before
+// each instruction, and only with watchpoints set are the CPU's memory
+// callbacks wrapped to look at the page flags. That makes one stub per
+// process, for the callbacks to find it.
+//
+// Registers, numbered for p and P and in this order for g and G, are A, X,
+// Y, S, P (8 bits each) and PC (16 bits). Memory is c->memory, accessed
+// without going through the callbacks.
+
+#ifndef NSG6502_GDB_H
+#define NSG6502_GDB_H
+
+// Breakpoints and single steps need every instruction to go through
+// nsg6502_opcode_execute on its own, superinstructions would skip them
+#ifdef NSG6502_FUSED
+#error "nsg6502_gdb.h cannot be used with NSG6502_FUSED"
+#endif
+
+#include "nsg6502.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define NSG6502_GDB_PACKET_SIZE 4096
+#define NSG6502_GDB_MAX_WATCHPOINTS 32
+#define NSG6502_GDB_POLL_TICKS 65536
+
+#define NSG6502_GDB_WATCH_WRITE 1
+#define NSG6502_GDB_WATCH_READ 2
+#define NSG6502_GDB_WATCH_ACCESS 3
+
+// Returned by nsg6502_gdb_run() when the client killed the program
+#define NSG6502_GDB_KILLED -1
+
+#define NSG6502_GDB_SIGINT 2
+#define NSG6502_GDB_SIGTRAP 5
+
+// nsg6502_gdb_receive() for a Ctrl-C outside a packet
+#define NSG6502_GDB_INTERRUPT -2
+
+struct nsg6502_gdb_watchpoint {
+	uint16_t addr;
+	uint16_t size;
+	uint8_t type;
+};
+
+struct nsg6502_gdb {
+	struct nsg6502_cpu *cpu;
+	int listen_fd;
+	int fd;
+	int no_ack;
+	int stopped;
+	// Set on resuming, to get off the breakpoint the CPU stopped at
+	int resumed;
+	// Tick at which to look at the socket next
+	size_t poll_at;
+
+	uint8_t breakpoints[0x10000 / 8];
+	size_t breakpoint_count;
+
+	struct nsg6502_gdb_watchpoint watchpoints[NSG6502_GDB_MAX_WATCHPOINTS];
+	size_t watchpoint_count;
+	// Watchpoint types set on any byte of each page
+	uint8_t watch_page[0x100];
+	// The host's callbacks, while ours are installed
+	uint8_t (*read)(struct nsg6502_cpu *, uint16_t);
+	void (*write)(struct nsg6502_cpu *, uint16_t, uint8_t);
+	int watching;
+	// Set by the callbacks when a watchpoint triggers
+	uint8_t hit_type;
+	uint16_t hit_addr;
+
+	char packet[NSG6502_GDB_PACKET_SIZE + 1];
+	uint8_t in[256];
+	size_t in_pos;
+	size_t in_len;
+};
+
+static struct nsg6502_gdb *nsg6502_gdb_instance;
+
+static void nsg6502_gdb_watch_check(struct nsg6502_gdb *g, uint16_t addr,
+									uint8_t type) {
+	if (!(g->watch_page[addr >> 8] & type) || g->hit_type) {
+		return;
+	}
+	for (size_t i = 0; i < g->watchpoint_count; i++) {
+		struct nsg6502_gdb_watchpoint *w = &g->watchpoints[i];
+		if ((w->type & type) && (uint16_t)(addr - w->addr) < w->size) {
+			g->hit_type = w->type;
+			g->hit_addr = addr;
+			return;
+		}
+	}
+}
+
+static uint8_t nsg6502_gdb_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_gdb *g = nsg6502_gdb_instance;
+	nsg6502_gdb_watch_check(g, addr, NSG6502_GDB_WATCH_READ);
+	return g->read ? g->read(c, addr) : c->memory[addr];
+}
+
+static void nsg6502_gdb_write(struct nsg6502_cpu *c, uint16_t addr,
+							  uint8_t data) {
+	struct nsg6502_gdb *g = nsg6502_gdb_instance;
+	nsg6502_gdb_watch_check(g, addr, NSG6502_GDB_WATCH_WRITE);
+	if (g->write) {
+		g->write(c, addr, data);
+	} else {
+		c->memory[addr] = data;
+	}
+}
+
+// Rebuilds the page flags, and puts our callbacks in or takes them out
+static void nsg6502_gdb_watch_update(struct nsg6502_gdb *g) {
+	struct nsg6502_cpu *c = g->cpu;
+	memset(g->watch_page, 0, sizeof(g->watch_page));
+	for (size_t i = 0; i < g->watchpoint_count; i++) {
+		struct nsg6502_gdb_watchpoint *w = &g->watchpoints[i];
+		uint32_t last = (uint32_t)w->addr + w->size - 1;
+		for (uint32_t page = w->addr >> 8; page <= last >> 8; page++) {
+			g->watch_page[page & 0xFF] |= w->type;
+		}
+	}
+	if (g->watchpoint_count && !g->watching) {
+		g->read = c->memory_read_callback;
+		g->write = c->memory_write_callback;
+		c->memory_read_callback = nsg6502_gdb_read;
+		c->memory_write_callback = nsg6502_gdb_write;
+		g->watching = 1;
+	} else if (!g->watchpoint_count && g->watching) {
+		c->memory_read_callback = g->read;
+		c->memory_write_callback = g->write;
+		g->watching = 0;
+	}
+}
+
+static void nsg6502_gdb_disconnect(struct nsg6502_gdb *g) {
+	if (g->fd >= 0) {
+		close(g->fd);
+	}
+	g->fd = -1;
+	g->no_ack = 0;
+	g->stopped = 0;
+	g->in_pos = g->in_len = 0;
+	memset(g->breakpoints, 0, sizeof(g->breakpoints));
+	g->breakpoint_count = 0;
+	g->watchpoint_count = 0;
+	nsg6502_gdb_watch_update(g);
+	g->hit_type = 0;
+}
+
+static int nsg6502_gdb_getc(struct nsg6502_gdb *g) {
+	if (g->in_pos == g->in_len) {
+		ssize_t n = read(g->fd, g->in, sizeof(g->in));
+		if (n <= 0) {
+			return -1;
+		}
+		g->in_pos = 0;
+		g->in_len = n;
+	}
+	return g->in[g->in_pos++];
+}
+
+static int nsg6502_gdb_hex(int ch) {
+	if (ch >= '0' && ch <= '9') {
+		return ch - '0';
+	}
+	if (ch >= 'a' && ch <= 'f') {
+		return ch - 'a' + 10;
+	}
+	if (ch >= 'A' && ch <= 'F') {
+		return ch - 'A' + 10;
+	}
+	return -1;
+}
+
+// Reads the next packet into g->packet. Returns its length, -1 when the
+// client is gone or NSG6502_GDB_INTERRUPT.
+static int nsg6502_gdb_receive(struct nsg6502_gdb *g) {
+	for (;;) {
+		int ch = nsg6502_gdb_getc(g);
+		if (ch < 0) {
+			return -1;
+		}
+		if (ch == 0x03) {
+			return NSG6502_GDB_INTERRUPT;
+		}
+		if (ch != '$') {
+			// Acks, and noise
+			continue;
+		}
+		int len = 0;
+		uint8_t sum = 0;
+		while ((ch = nsg6502_gdb_getc(g)) != '#') {
+			if (ch < 0) {
+				return -1;
+			}
+			if (len < NSG6502_GDB_PACKET_SIZE) {
+				g->packet[len++] = ch;
+			}
+			sum += ch;
+		}
+		int high = nsg6502_gdb_hex(nsg6502_gdb_getc(g));
+		int low = nsg6502_gdb_hex(nsg6502_gdb_getc(g));
+		g->packet[len] = '\0';
+		if (g->no_ack) {
+			return len;
+		}
+		if (high < 0 || low < 0 || ((high << 4) | low) != sum) {
+			if (write(g->fd, "-", 1) != 1) {
+				return -1;
+			}
+			continue;
+		}
+		if (write(g->fd, "+", 1) != 1) {
+			return -1;
+		}
+		return len;
+	}
+}
+
+static void nsg6502_gdb_send(struct nsg6502_gdb *g, const char *data) {
+	char frame[NSG6502_GDB_PACKET_SIZE + 5];
+	uint8_t sum = 0;
+	size_t len = strlen(data);
+	for (size_t i = 0; i < len; i++) {
+		sum += data[i];
+	}
+	int n = snprintf(frame, sizeof(frame), "$%s#%02x", data, sum);
+	for (ssize_t done = 0, w; done < n; done += w) {
+		w = write(g->fd, frame + done, n - done);
+		if (w <= 0) {
+			return;
+		}
+	}
+}
+
+static void nsg6502_gdb_stop(struct nsg6502_gdb *g, int signal) {
+	char reply[32];
+	if (g->hit_type) {
+		const char *kind = g->hit_type == NSG6502_GDB_WATCH_WRITE  ? "watch"
+						   : g->hit_type == NSG6502_GDB_WATCH_READ ? "rwatch"
+																   : "awatch";
+		snprintf(reply, sizeof(reply), "T%02x%s:%x;", signal, kind,
+				 g->hit_addr);
+		g->hit_type = 0;
+	} else {
+		snprintf(reply, sizeof(reply), "S%02x", signal);
+	}
+	g->stopped = 1;
+	nsg6502_gdb_send(g, reply);
+}
+
+static int nsg6502_gdb_breakpoint(struct nsg6502_gdb *g, uint16_t pc) {
+	return g->breakpoints[pc >> 3] & (1 << (pc & 7));
+}
+
+// Z and z packets. Returns 0 on success.
+static int nsg6502_gdb_point(struct nsg6502_gdb *g, const char *p, int set) {
+	char *end;
+	int kind = strtol(p + 1, &end, 16);
+	uint16_t addr = strtoul(end + 1, &end, 16);
+	uint32_t size = *end == ',' ? strtoul(end + 1, NULL, 16) : 1;
+	if (kind == 0 || kind == 1) {
+		uint8_t bit = 1 << (addr & 7);
+		if (set && !(g->breakpoints[addr >> 3] & bit)) {
+			g->breakpoints[addr >> 3] |= bit;
+			g->breakpoint_count++;
+		} else if (!set && (g->breakpoints[addr >> 3] & bit)) {
+			g->breakpoints[addr >> 3] &= ~bit;
+			g->breakpoint_count--;
+		}
+		return 0;
+	}
+	if (kind < 2 || kind > 4 || !size || size > 0x10000) {
+		return -1;
+	}
+	uint8_t type = kind == 2   ? NSG6502_GDB_WATCH_WRITE
+				   : kind == 3 ? NSG6502_GDB_WATCH_READ
+							   : NSG6502_GDB_WATCH_ACCESS;
+	if (set) {
+		if (g->watchpoint_count == NSG6502_GDB_MAX_WATCHPOINTS) {
+			return -1;
+		}
+		g->watchpoints[g->watchpoint_count++] =
+			(struct nsg6502_gdb_watchpoint){addr, size, type};
+	} else {
+		for (size_t i = 0; i < g->watchpoint_count; i++) {
+			struct nsg6502_gdb_watchpoint *w = &g->watchpoints[i];
+			if (w->addr == addr && w->size == (uint16_t)size &&
+				w->type == type) {
+				*w = g->watchpoints[--g->watchpoint_count];
+				break;
+			}
+		}
+	}
+	nsg6502_gdb_watch_update(g);
+	return 0;
+}
+
+static void nsg6502_gdb_registers(struct nsg6502_gdb *g, char *out) {
+	struct nsg6502_cpu *c = g->cpu;
+	nsg6502_flags_resolve(c);
+	sprintf(out, "%02x%02x%02x%02x%02x%02x%02x", c->a, c->x, c->y, c->sp,
+			c->status, c->pc & 0xFF, c->pc >> 8);
+}
+
+// Sets register n from the hex digits at p. Returns 0 on success.
+static int nsg6502_gdb_set_register(struct nsg6502_gdb *g, int n,
+									const char *p) {
+	struct nsg6502_cpu *c = g->cpu;
+	uint8_t *regs[] = {&c->a, &c->x, &c->y, &c->sp, &c->status};
+	int high = nsg6502_gdb_hex(p[0]);
+	int low = nsg6502_gdb_hex(p[1]);
+	if (high < 0 || low < 0) {
+		return -1;
+	}
+	nsg6502_flags_resolve(c);
+	if (n < 5) {
+		*regs[n] = (high << 4) | low;
+		return 0;
+	}
+	if (n == 5) {
+		int high2 = nsg6502_gdb_hex(p[2]);
+		int low2 = nsg6502_gdb_hex(p[3]);
+		if (high2 < 0 || low2 < 0) {
+			return -1;
+		}
+		c->pc = (high << 4) | low | (((high2 << 4) | low2) << 8);
+		return 0;
+	}
+	return -1;
+}
+
+static void nsg6502_gdb_step(struct nsg6502_gdb *g) {
+	nsg6502_opcode_execute(g->cpu);
+	nsg6502_gdb_stop(g, NSG6502_GDB_SIGTRAP);
+}
+
+// Serves the client while the CPU is stopped. Returns once it resumes the
+// CPU or is gone, or NSG6502_GDB_KILLED.
+static int nsg6502_gdb_serve(struct nsg6502_gdb *g) {
+	struct nsg6502_cpu *c = g->cpu;
+	char reply[NSG6502_GDB_PACKET_SIZE + 1];
+	while (g->stopped) {
+		int len = nsg6502_gdb_receive(g);
+		if (len < 0) {
+			if (len == NSG6502_GDB_INTERRUPT) {
+				continue;
+			}
+			nsg6502_gdb_disconnect(g);
+			return 0;
+		}
+		char *p = g->packet;
+		char *end;
+		reply[0] = '\0';
+		switch (p[0]) {
+			case '?':
+				nsg6502_gdb_stop(g, NSG6502_GDB_SIGTRAP);
+				continue;
+			case 'g':
+				nsg6502_gdb_registers(g, reply);
+				break;
+			case 'G': {
+				// All 14 digits are checked first, a bad packet must not set
+				// anything
+				int ok = len == 15;
+				for (int i = 1; ok && i < 15; i++) {
+					ok = nsg6502_gdb_hex(p[i]) >= 0;
+				}
+				for (int i = 0; ok && i < 6; i++) {
+					ok = nsg6502_gdb_set_register(g, i, p + 1 + i * 2) == 0;
+				}
+				strcpy(reply, ok ? "OK" : "E01");
+				break;
+			}
+			case 'p': {
+				int n = strtol(p + 1, NULL, 16);
+				char regs[16];
+				nsg6502_gdb_registers(g, regs);
+				if (n < 0 || n > 5) {
+					strcpy(reply, "E01");
+				} else {
+					memcpy(reply, regs + n * 2, n == 5 ? 4 : 2);
+					reply[n == 5 ? 4 : 2] = '\0';
+				}
+				break;
+			}
+			case 'P': {
+				int n = strtol(p + 1, &end, 16);
+				int ok = *end == '=' &&
+						 nsg6502_gdb_set_register(g, n, end + 1) == 0;
+				strcpy(reply, ok ? "OK" : "E01");
+				break;
+			}
+			case 'm': {
+				uint16_t addr = strtoul(p + 1, &end, 16);
+				size_t size = *end == ',' ? strtoul(end + 1, NULL, 16) : 0;
+				if (!c->memory || size > NSG6502_GDB_PACKET_SIZE / 2) {
+					strcpy(reply, "E01");
+					break;
+				}
+				for (size_t i = 0; i < size; i++) {
+					sprintf(reply + i * 2, "%02x",
+							c->memory[(uint16_t)(addr + i)]);
+				}
+				break;
+			}
+			case 'M': {
+				uint16_t addr = strtoul(p + 1, &end, 16);
+				size_t size = *end == ',' ? strtoul(end + 1, &end, 16) : 0;
+				const char *data = end + 1;
+				int valid = c->memory && *end == ':' &&
+							strlen(data) == size * 2;
+				// Checked in full first, a bad packet must not write anything
+				for (size_t i = 0; valid && i < size * 2; i++) {
+					valid = nsg6502_gdb_hex(data[i]) >= 0;
+				}
+				if (!valid) {
+					strcpy(reply, "E01");
+					break;
+				}
+				for (size_t i = 0; i < size; i++) {
+					c->memory[(uint16_t)(addr + i)] =
+						(nsg6502_gdb_hex(end[1 + i * 2]) << 4) |
+						nsg6502_gdb_hex(end[2 + i * 2]);
+				}
+				strcpy(reply, "OK");
+				break;
+			}
+			case 'Z':
+			case 'z': {
+				int ok = nsg6502_gdb_point(g, p, p[0] == 'Z') == 0;
+				strcpy(reply, ok ? "OK" : "E01");
+				break;
+			}
+			case 's':
+				if (p[1]) {
+					c->pc = strtoul(p + 1, NULL, 16);
+				}
+				nsg6502_gdb_step(g);
+				continue;
+			case 'c':
+				if (p[1]) {
+					c->pc = strtoul(p + 1, NULL, 16);
+				}
+				g->stopped = 0;
+				g->resumed = 1;
+				return 0;
+			case 'D':
+				nsg6502_gdb_send(g, "OK");
+				nsg6502_gdb_disconnect(g);
+				return 0;
+			case 'k':
+				nsg6502_gdb_disconnect(g);
+				return NSG6502_GDB_KILLED;
+			case 'H':
+				strcpy(reply, "OK");
+				break;
+			case 'q':
+				if (!strncmp(p, "qSupported", 10)) {
+					sprintf(reply, "PacketSize=%x;QStartNoAckMode+",
+							NSG6502_GDB_PACKET_SIZE);
+				} else if (!strcmp(p, "qAttached")) {
+					strcpy(reply, "1");
+				}
+				break;
+			case 'Q':
+				if (!strcmp(p, "QStartNoAckMode")) {
+					nsg6502_gdb_send(g, "OK");
+					g->no_ack = 1;
+					continue;
+				}
+				break;
+		}
+		// Anything not handled gets the empty reply, "not supported"
+		nsg6502_gdb_send(g, reply);
+	}
+	return 0;
+}
+
+// Takes a new client, stopping the CPU for it, or a Ctrl-C from the
+// current one. Never blocks.
+static void nsg6502_gdb_poll(struct nsg6502_gdb *g) {
+	if (g->fd < 0) {
+		if (g->listen_fd < 0) {
+			return;
+		}
+		g->fd = accept(g->listen_fd, NULL, NULL);
+		if (g->fd >= 0) {
+			// Packets are small and answered one at a time
+			int one = 1;
+			setsockopt(g->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			g->stopped = 1;
+		}
+		return;
+	}
+	struct pollfd pfd = {g->fd, POLLIN, 0};
+	while (g->in_pos < g->in_len || poll(&pfd, 1, 0) > 0) {
+		int ch = nsg6502_gdb_getc(g);
+		if (ch < 0) {
+			nsg6502_gdb_disconnect(g);
+			return;
+		}
+		if (ch == 0x03) {
+			nsg6502_gdb_stop(g, NSG6502_GDB_SIGINT);
+			return;
+		}
+	}
+}
+
+// Blocks until a client connects, for guests that would otherwise block
+// in their own devices before one can
+static void nsg6502_gdb_wait(struct nsg6502_gdb *g) {
+	struct pollfd pfd = {g->listen_fd, POLLIN, 0};
+	while (g->fd < 0 && poll(&pfd, 1, -1) >= 0) {
+		nsg6502_gdb_poll(g);
+	}
+}
+
+// Runs with breakpoints or watchpoints set, up to end or a stop
+static void nsg6502_gdb_run_checked(struct nsg6502_gdb *g, size_t end) {
+	struct nsg6502_cpu *c = g->cpu;
+	while (c->ticks < end) {
+		if (!g->resumed && nsg6502_gdb_breakpoint(g, c->pc)) {
+			nsg6502_gdb_stop(g, NSG6502_GDB_SIGTRAP);
+			return;
+		}
+		g->resumed = 0;
+		nsg6502_opcode_execute(c);
+		if (g->hit_type) {
+			nsg6502_gdb_stop(g, NSG6502_GDB_SIGTRAP);
+			return;
+		}
+	}
+}
+
+// Runs the CPU for ticks ticks, less the time it spends stopped. Returns 0,
+// or NSG6502_GDB_KILLED once the client asked for that.
+static int nsg6502_gdb_run(struct nsg6502_gdb *g, size_t ticks) {
+	struct nsg6502_cpu *c = g->cpu;
+	size_t end = c->ticks + ticks;
+	while (c->ticks < end) {
+		if (c->ticks >= g->poll_at) {
+			nsg6502_gdb_poll(g);
+			g->poll_at = c->ticks + NSG6502_GDB_POLL_TICKS;
+		}
+		if (g->stopped) {
+			size_t before = c->ticks;
+			if (nsg6502_gdb_serve(g) == NSG6502_GDB_KILLED) {
+				return NSG6502_GDB_KILLED;
+			}
+			end += c->ticks - before;
+			g->poll_at = c->ticks + NSG6502_GDB_POLL_TICKS;
+			continue;
+		}
+		size_t slice = end < g->poll_at ? end : g->poll_at;
+		if (g->breakpoint_count || g->watchpoint_count) {
+			nsg6502_gdb_run_checked(g, slice);
+		} else {
+			g->resumed = 0;
+			while (c->ticks < slice) {
+				nsg6502_opcode_execute(c);
+			}
+		}
+	}
+	return 0;
+}
+
+// address is "host:port" for TCP or a path for a Unix socket. The host
+// has to be a loopback address, 127.0.0.0/8 or localhost, or empty for
+// 127.0.0.1: the stub reads and writes all of memory for anyone connecting.
+// Returns 0 on success.
+static int nsg6502_gdb_listen(struct nsg6502_gdb *g, struct nsg6502_cpu *c,
+							  const char *address) {
+	*g = (struct nsg6502_gdb){0};
+	g->cpu = c;
+	g->fd = -1;
+	g->listen_fd = -1;
+	nsg6502_gdb_instance = g;
+
+	struct sockaddr_storage storage = {0};
+	socklen_t len;
+	const char *colon = strrchr(address, ':');
+	if (colon && address[0] != '/') {
+		struct sockaddr_in *in = (struct sockaddr_in *)&storage;
+		in->sin_family = AF_INET;
+		in->sin_port = htons(atoi(colon + 1));
+		char host[64] = "127.0.0.1";
+		size_t host_len = colon - address;
+		if (host_len && host_len < sizeof(host) &&
+			strncmp(address, "localhost", host_len) != 0) {
+			memcpy(host, address, host_len);
+			host[host_len] = '\0';
+		}
+		if (inet_pton(AF_INET, host, &in->sin_addr) != 1 ||
+			ntohl(in->sin_addr.s_addr) >> 24 != 127) {
+			return -1;
+		}
+		len = sizeof(*in);
+	} else {
+		struct sockaddr_un *un = (struct sockaddr_un *)&storage;
+		un->sun_family = AF_UNIX;
+		if (strlen(address) >= sizeof(un->sun_path)) {
+			return -1;
+		}
+		strcpy(un->sun_path, address);
+		unlink(address);
+		len = sizeof(*un);
+	}
+
+	int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+	int one = 1;
+	if (fd < 0 ||
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+		bind(fd, (struct sockaddr *)&storage, len) != 0 || listen(fd, 1) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	g->listen_fd = fd;
+	return 0;
+}
+
+static void nsg6502_gdb_close(struct nsg6502_gdb *g) {
+	nsg6502_gdb_disconnect(g);
+	if (g->listen_fd >= 0) {
+		close(g->listen_fd);
+	}
+	g->listen_fd = -1;
+	if (nsg6502_gdb_instance == g) {
+		nsg6502_gdb_instance = NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include "nsg6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// usage: nsg6502_hpp_check [states] [steps]
+//
+// Runs random memory and register states, 300 of 20000 steps each by
+// default, through the C core and through nsg6502::Cpu with a concrete
+// bus, with CallbackBus and with MemoryBus, and compares registers, ticks,
+// memory and every bus access in order. Some states start with IRQ or NMI
+// raised. The file holds both halves: compile it as C for the C core and
+// as C++ for the rest, with the same NSG6502_* options, e.g.
+// cc -x c -c nsg6502_hpp_check.cpp -o nsg6502_hpp_check_c.o
+// c++ nsg6502_hpp_check.cpp nsg6502_hpp_check_c.o
+
+#define CHECK_MAX_ACCESSES (1 << 20)
+
+// One entry per access, (write << 24) | (addr << 8) | data
+struct check_trace {
+	uint32_t accesses[CHECK_MAX_ACCESSES];
+	size_t count;
+};
+
+static void check_record(struct check_trace *t, uint32_t write, uint16_t addr,
+						 uint8_t data) {
+	if (t->count < CHECK_MAX_ACCESSES) {
+		t->accesses[t->count] = (write << 24) | ((uint32_t)addr << 8) | data;
+	}
+	t->count++;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void check_c_run(struct nsg6502_cpu *c, struct check_trace *t, size_t steps);
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef __cplusplus
+static struct check_trace *check_c_trace;
+
+static uint8_t check_c_read(struct nsg6502_cpu *c, uint16_t addr) {
+	check_record(check_c_trace, 0, addr, c->memory[addr]);
+	return c->memory[addr];
+}
+
+static void check_c_write(struct nsg6502_cpu *c, uint16_t addr,
+						  uint8_t data) {
+	check_record(check_c_trace, 1, addr, data);
+	c->memory[addr] = data;
+}
+
+void check_c_run(struct nsg6502_cpu *c, struct check_trace *t, size_t steps) {
+	check_c_trace = t;
+	c->memory_read_callback = check_c_read;
+	c->memory_write_callback = check_c_write;
+	for (size_t i = 0; i < steps; i++) {
+		nsg6502_opcode_execute(c);
+	}
+	nsg6502_flags_resolve(c);
+}
+#else
+#include "nsg6502.hpp"
+
+// The C callbacks through CallbackBus
+static struct check_trace *check_callback_trace;
+
+static uint8_t check_callback_read(struct nsg6502_cpu *c, uint16_t addr) {
+	check_record(check_callback_trace, 0, addr, c->memory[addr]);
+	return c->memory[addr];
+}
+
+static void check_callback_write(struct nsg6502_cpu *c, uint16_t addr,
+								 uint8_t data) {
+	check_record(check_callback_trace, 1, addr, data);
+	c->memory[addr] = data;
+}
+
+// A bus the compiler sees through
+struct check_bus {
+	struct check_trace *trace;
+
+	uint8_t read(struct nsg6502_cpu *c, uint16_t addr) {
+		check_record(trace, 0, addr, c->memory[addr]);
+		return c->memory[addr];
+	}
+	void write(struct nsg6502_cpu *c, uint16_t addr, uint8_t data) {
+		check_record(trace, 1, addr, data);
+		c->memory[addr] = data;
+	}
+};
+
+static uint64_t check_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t check_random() {
+	check_state ^= check_state << 13;
+	check_state ^= check_state >> 7;
+	check_state ^= check_state << 17;
+	return check_state;
+}
+
+static int check_compare(const char *name, size_t n,
+						 const struct nsg6502_cpu *want,
+						 const struct nsg6502_cpu *got,
+						 const struct check_trace *want_trace,
+						 const struct check_trace *got_trace) {
+	if (want->a != got->a || want->x != got->x || want->y != got->y ||
+		want->sp != got->sp || want->pc != got->pc ||
+		want->status != got->status || want->ticks != got->ticks ||
+		want->irq != got->irq || want->nmi != got->nmi
+#ifdef NSG6502_65C02
+		|| want->halt != got->halt
+#endif
+	) {
+		fprintf(stderr,
+				"state %zu, %s: C has A=%02X X=%02X Y=%02X S=%02X P=%02X "
+				"PC=%04X ticks=%zu, C++ A=%02X X=%02X Y=%02X S=%02X P=%02X "
+				"PC=%04X ticks=%zu\n",
+				n, name, want->a, want->x, want->y, want->sp, want->status,
+				want->pc, want->ticks, got->a, got->x, got->y, got->sp,
+				got->status, got->pc, got->ticks);
+		return 1;
+	}
+	if (memcmp(want->memory, got->memory, 0x10000) != 0) {
+		fprintf(stderr, "state %zu, %s: memory differs\n", n, name);
+		return 1;
+	}
+	if (got_trace && (want_trace->count != got_trace->count ||
+					  memcmp(want_trace->accesses, got_trace->accesses,
+							 (want_trace->count < CHECK_MAX_ACCESSES
+								  ? want_trace->count
+								  : CHECK_MAX_ACCESSES) *
+								 sizeof(uint32_t)) != 0)) {
+		fprintf(stderr, "state %zu, %s: bus accesses differ\n", n, name);
+		return 1;
+	}
+	return 0;
+}
+
+static uint8_t check_initial[0x10000];
+static uint8_t check_memory[4][0x10000];
+static struct check_trace check_traces[3];
+
+int main(int argc, char **argv) {
+	size_t states = argc > 1 ? strtoul(argv[1], NULL, 0) : 300;
+	size_t steps = argc > 2 ? strtoul(argv[2], NULL, 0) : 20000;
+	size_t accesses = 0;
+
+	for (size_t n = 0; n < states; n++) {
+		for (size_t i = 0; i < sizeof(check_initial); i++) {
+			check_initial[i] = check_random();
+		}
+		struct nsg6502_cpu start;
+		memset(&start, 0, sizeof(start));
+		uint64_t r = check_random();
+		start.a = r;
+		start.x = r >> 8;
+		start.y = r >> 16;
+		start.sp = r >> 24;
+		start.status = (r >> 32) & ~(NSG6502_STATUS_REGISTER_BREAK | 0x20);
+		start.pc = r >> 40;
+		start.irq = (r >> 56) % 4 == 0;
+		start.nmi = (r >> 58) % 8 == 0;
+		for (int i = 0; i < 4; i++) {
+			memcpy(check_memory[i], check_initial, sizeof(check_initial));
+		}
+		for (int i = 0; i < 3; i++) {
+			check_traces[i].count = 0;
+		}
+
+		struct nsg6502_cpu c = start;
+		c.memory = check_memory[0];
+		check_c_run(&c, &check_traces[0], steps);
+		accesses += check_traces[0].count;
+
+		nsg6502::Cpu<check_bus> bus(check_bus{&check_traces[1]});
+		static_cast<struct nsg6502_cpu &>(bus) = start;
+		bus.memory = check_memory[1];
+
+		nsg6502::Cpu<nsg6502::CallbackBus> callback;
+		static_cast<struct nsg6502_cpu &>(callback) = start;
+		callback.memory = check_memory[2];
+		callback.memory_read_callback = check_callback_read;
+		callback.memory_write_callback = check_callback_write;
+		check_callback_trace = &check_traces[2];
+
+		nsg6502::Cpu<nsg6502::MemoryBus> memory;
+		static_cast<struct nsg6502_cpu &>(memory) = start;
+		memory.memory = check_memory[3];
+
+		for (size_t i = 0; i < steps; i++) {
+			bus.step();
+			callback.step();
+			memory.step();
+		}
+		nsg6502_flags_resolve(&bus);
+		nsg6502_flags_resolve(&callback);
+		nsg6502_flags_resolve(&memory);
+
+		if (check_compare("concrete bus", n, &c, &bus, &check_traces[0],
+						  &check_traces[1]) ||
+			check_compare("CallbackBus", n, &c, &callback, &check_traces[0],
+						  &check_traces[2]) ||
+			check_compare("MemoryBus", n, &c, &memory, &check_traces[0],
+						  NULL)) {
+			return 1;
+		}
+	}
+	printf("states=%zu steps=%zu accesses=%zu match\n", states, steps,
+		   accesses);
+	return 0;
+}
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Serial link between two CPUs.
+//
+// Each direction is a single producer, single consumer ring in memory
+// shared by both ends, in one process or, mapped from a file such as one
+// under /dev/shm, in two. No locks and no system calls on the way.
+//
+// Bytes are stamped with the sender's ticks plus the link's latency and
+// only show up at the receiver once its own ticks reach the stamp, so both
+// guests see the same timing no matter how the hosts schedule them. For
+// that the receiver may have to wait: when nothing has arrived yet it
+// cannot tell "no byte" from "the sender has not got there yet" until the
+// sender's clock, plus the latency, has passed its own. Each end publishes
+// its clock whenever the guest touches the link; a host running a guest
+// that rarely does should call nsg6502_link_publish() now and then, e.g.
+// every slice, or the other end waits for it. Once an end is closed the
+// other one stops waiting for it. Only a full ring, NSG6502_LINK_RING_SIZE
+// bytes the receiver has not read yet, depends on how the hosts run.
+//
+// By default an end waits as long as it takes, which needs the other end
+// to run on another thread. When one thread runs both, set spin_limit and
+// step the CPU with nsg6502_link_execute(): an instruction that would have
+// to wait longer is rolled back and NSG6502_LINK_BLOCKED returned, so the
+// caller can end the slice and run the other side.
+//
+// Registers, from the base the device is attached at:
+//   0  read: next byte, write: send a byte
+//   1  status, read only
+
+#ifndef NSG6502_LINK_H
+#define NSG6502_LINK_H
+
+#include "nsg6502.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define NSG6502_LINK_REGISTERS 2
+#define NSG6502_LINK_RING_SIZE 1024
+
+#define NSG6502_LINK_STATUS_RX (1 << 0)
+#define NSG6502_LINK_STATUS_TX (1 << 1)
+#define NSG6502_LINK_STATUS_OVERRUN (1 << 6)
+
+#define NSG6502_LINK_RUNNING 0
+#define NSG6502_LINK_BLOCKED 1
+
+struct nsg6502_link_ring {
+	// Written by the sender only
+	_Alignas(64) atomic_uint head;
+	// Written by the receiver only
+	_Alignas(64) atomic_uint tail;
+	_Alignas(64) uint64_t stamp[NSG6502_LINK_RING_SIZE];
+	uint8_t data[NSG6502_LINK_RING_SIZE];
+};
+
+// All zero is a valid, empty state, so the file end 0 creates needs no
+// setting up
+struct nsg6502_link_shared {
+	// ring[i] carries bytes from end i to the other one
+	struct nsg6502_link_ring ring[2];
+	_Alignas(64) atomic_uint_fast64_t clock[2];
+	atomic_uint closed[2];
+};
+
+struct nsg6502_link {
+	struct nsg6502_cpu *cpu;
+	struct nsg6502_link_shared *shared;
+	// 0 or 1, the other end has to use the other one
+	int side;
+	// Ticks from send to arrival, at least 1
+	uint64_t latency;
+	uint8_t status;
+	int mapped;
+	// How often to look at the other end's clock before giving up, 0 to
+	// wait for as long as it takes
+	size_t spin_limit;
+	// Set when the guest touched the link and gave up waiting
+	int blocked;
+};
+
+static void nsg6502_link_init(struct nsg6502_link *l, struct nsg6502_cpu *c,
+							  struct nsg6502_link_shared *shared, int side,
+							  uint64_t latency) {
+	*l = (struct nsg6502_link){0};
+	l->cpu = c;
+	l->shared = shared;
+	l->side = side;
+	l->latency = latency ? latency : 1;
+}
+
+// Maps path and uses it as end side of the link. End 0 sets the file up:
+// it removes whatever a previous run left at path and creates it afresh,
+// all zero, so start end 1 only once end 0 has opened it. End 1 maps the
+// file as it is and fails if there is none.
+static int nsg6502_link_open(struct nsg6502_link *l, struct nsg6502_cpu *c,
+							 const char *path, int side, uint64_t latency) {
+	int fd;
+	if (side == 0) {
+		if (unlink(path) != 0 && errno != ENOENT) {
+			return -1;
+		}
+		fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	} else {
+		fd = open(path, O_RDWR);
+	}
+	if (fd < 0) {
+		return -1;
+	}
+	struct nsg6502_link_shared *shared = MAP_FAILED;
+	if (ftruncate(fd, sizeof(*shared)) == 0) {
+		shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+					  MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (shared == MAP_FAILED) {
+		return -1;
+	}
+	nsg6502_link_init(l, c, shared, side, latency);
+	l->mapped = 1;
+	return 0;
+}
+
+static void nsg6502_link_publish(struct nsg6502_link *l) {
+	atomic_store_explicit(&l->shared->clock[l->side], l->cpu->ticks,
+						  memory_order_release);
+}
+
+static void nsg6502_link_close(struct nsg6502_link *l) {
+	atomic_store_explicit(&l->shared->closed[l->side], 1,
+						  memory_order_release);
+	if (l->mapped) {
+		munmap(l->shared, sizeof(*l->shared));
+	}
+	l->shared = NULL;
+}
+
+// Whether a byte has arrived by now. Waits until the answer is final, or
+// returns -1 after spin_limit looks at the other end.
+static int nsg6502_link_ready(struct nsg6502_link *l) {
+	struct nsg6502_link_shared *s = l->shared;
+	struct nsg6502_link_ring *r = &s->ring[!l->side];
+	uint64_t now = l->cpu->ticks;
+	nsg6502_link_publish(l);
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	for (size_t spins = 0;; spins++) {
+		// The clock is read before head: once it is past, every byte sent
+		// before it is in the ring
+		uint64_t peer =
+			atomic_load_explicit(&s->clock[!l->side], memory_order_acquire);
+		uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+		if (head != tail) {
+			return r->stamp[tail % NSG6502_LINK_RING_SIZE] <= now;
+		}
+		if (peer + l->latency > now ||
+			atomic_load_explicit(&s->closed[!l->side], memory_order_acquire)) {
+			return 0;
+		}
+		if (l->spin_limit && spins + 1 >= l->spin_limit) {
+			return -1;
+		}
+		if (spins >= 64) {
+			sched_yield();
+		}
+	}
+}
+
+static uint8_t nsg6502_link_read(void *data, uint16_t reg) {
+	struct nsg6502_link *l = data;
+	struct nsg6502_link_ring *rx = &l->shared->ring[!l->side];
+	int ready = nsg6502_link_ready(l);
+	if (ready < 0) {
+		// Nothing is consumed, the instruction is going to be rolled back
+		l->blocked = 1;
+		return 0;
+	}
+	uint32_t tail = atomic_load_explicit(&rx->tail, memory_order_relaxed);
+	if (reg == 0) {
+		if (!ready) {
+			return 0;
+		}
+		uint8_t byte = rx->data[tail % NSG6502_LINK_RING_SIZE];
+		atomic_store_explicit(&rx->tail, tail + 1, memory_order_release);
+		return byte;
+	}
+	if (reg == 1) {
+		struct nsg6502_link_ring *tx = &l->shared->ring[l->side];
+		uint32_t head = atomic_load_explicit(&tx->head, memory_order_relaxed);
+		uint8_t status = l->status;
+		l->status = 0;
+		if (ready) {
+			status |= NSG6502_LINK_STATUS_RX;
+		}
+		if (head - atomic_load_explicit(&tx->tail, memory_order_acquire) <
+			NSG6502_LINK_RING_SIZE) {
+			status |= NSG6502_LINK_STATUS_TX;
+		}
+		return status;
+	}
+	return 0;
+}
+
+// A byte sent while the ring is full is dropped and reported as an overrun
+// on the next status read
+static void nsg6502_link_write(void *data, uint16_t reg, uint8_t value) {
+	struct nsg6502_link *l = data;
+	if (reg != 0 || l->blocked) {
+		return;
+	}
+	struct nsg6502_link_ring *tx = &l->shared->ring[l->side];
+	uint32_t head = atomic_load_explicit(&tx->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&tx->tail, memory_order_acquire) >=
+		NSG6502_LINK_RING_SIZE) {
+		l->status |= NSG6502_LINK_STATUS_OVERRUN;
+		return;
+	}
+	tx->stamp[head % NSG6502_LINK_RING_SIZE] = l->cpu->ticks + l->latency;
+	tx->data[head % NSG6502_LINK_RING_SIZE] = value;
+	atomic_store_explicit(&tx->head, head + 1, memory_order_release);
+	nsg6502_link_publish(l);
+}
+
+// Runs one instruction of the CPU at this end. If it had to give up
+// waiting for the other end, the instruction is undone and
+// NSG6502_LINK_BLOCKED returned; the CPU retries it on the next call.
+static int nsg6502_link_execute(struct nsg6502_link *l) {
+	struct nsg6502_cpu saved = *l->cpu;
+	l->blocked = 0;
+	nsg6502_opcode_execute(l->cpu);
+	if (l->blocked) {
+		*l->cpu = saved;
+		return NSG6502_LINK_BLOCKED;
+	}
+	return NSG6502_LINK_RUNNING;
+}
+
+#endif
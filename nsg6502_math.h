@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Multiply and divide coprocessor.
+//
+// The guest writes two operands and an operation, and reads the result back
+// right away: the operation completes on the write, and the CPU is charged
+// mul_ticks or div_ticks for it (twice that for 32 bit operations). Setting
+// NSG6502_MATH_SIGNED in the operation treats the operands as two's
+// complement. Dividing by zero sets the error bit and gives a quotient of
+// all ones and the dividend as remainder.
+//
+// Registers, from the base the device is attached at, all little endian:
+//   0-3    operand A, the multiplicand or dividend
+//   4-7    operand B, the multiplier or divisor
+//   8      write: operation, read: status
+//   16-23  product, or quotient in 16-19 and remainder in 20-23
+//
+// 16 bit operations only look at the low two bytes of each operand.
+// nsg6502_math.s has guest routines using it, nsg6502_math_rom.h the same
+// assembled, and nsg6502_math_check compares them with plain 6502 ones.
+
+#ifndef NSG6502_MATH_H
+#define NSG6502_MATH_H
+
+#include "nsg6502_bus.h"
+
+#define NSG6502_MATH_REGISTERS 24
+
+#define NSG6502_MATH_MUL16 1
+#define NSG6502_MATH_MUL32 2
+#define NSG6502_MATH_DIV16 3
+#define NSG6502_MATH_DIV32 4
+#define NSG6502_MATH_SIGNED 0x80
+
+#define NSG6502_MATH_STATUS_ERROR (1 << 6)
+
+struct nsg6502_math {
+	struct nsg6502_cpu *cpu;
+	size_t mul_ticks;
+	size_t div_ticks;
+
+	uint32_t a;
+	uint32_t b;
+	uint8_t status;
+	uint8_t result[8];
+};
+
+static void nsg6502_math_result(struct nsg6502_math *m, uint64_t low,
+								uint64_t high) {
+	for (int i = 0; i < 4; i++) {
+		m->result[i] = (low >> (i * 8)) & 0xFF;
+		m->result[i + 4] = (high >> (i * 8)) & 0xFF;
+	}
+}
+
+static void nsg6502_math_operation(struct nsg6502_math *m, uint8_t op) {
+	int is_signed = op & NSG6502_MATH_SIGNED;
+	op &= ~NSG6502_MATH_SIGNED;
+	int wide = op == NSG6502_MATH_MUL32 || op == NSG6502_MATH_DIV32;
+	// Sign or zero extend the operands to 64 bits, which holds every
+	// product and quotient including INT32_MIN / -1
+	int64_t a, b;
+	if (wide) {
+		a = is_signed ? (int64_t)(int32_t)m->a : (int64_t)m->a;
+		b = is_signed ? (int64_t)(int32_t)m->b : (int64_t)m->b;
+	} else {
+		a = is_signed ? (int64_t)(int16_t)m->a : (int64_t)(uint16_t)m->a;
+		b = is_signed ? (int64_t)(int16_t)m->b : (int64_t)(uint16_t)m->b;
+	}
+	m->status = 0;
+
+	switch (op) {
+		case NSG6502_MATH_MUL16:
+		case NSG6502_MATH_MUL32: {
+			uint64_t product = (uint64_t)a * (uint64_t)b;
+			if (!wide) {
+				product &= 0xFFFFFFFF;
+			}
+			nsg6502_math_result(m, product, product >> 32);
+			m->cpu->ticks += m->mul_ticks << wide;
+			break;
+		}
+		case NSG6502_MATH_DIV16:
+		case NSG6502_MATH_DIV32: {
+			uint32_t mask = wide ? 0xFFFFFFFF : 0xFFFF;
+			if (!b) {
+				m->status = NSG6502_MATH_STATUS_ERROR;
+				nsg6502_math_result(m, mask, a & mask);
+			} else {
+				nsg6502_math_result(m, (a / b) & mask, (a % b) & mask);
+			}
+			m->cpu->ticks += m->div_ticks << wide;
+			break;
+		}
+		default:
+			m->status = NSG6502_MATH_STATUS_ERROR;
+	}
+}
+
+static uint8_t nsg6502_math_read(void *data, uint16_t reg) {
+	struct nsg6502_math *m = data;
+	if (reg < 4) {
+		return (m->a >> (reg * 8)) & 0xFF;
+	}
+	if (reg < 8) {
+		return (m->b >> ((reg - 4) * 8)) & 0xFF;
+	}
+	if (reg == 8) {
+		return m->status;
+	}
+	if (reg >= 16 && reg < NSG6502_MATH_REGISTERS) {
+		return m->result[reg - 16];
+	}
+	return 0;
+}
+
+static void nsg6502_math_write(void *data, uint16_t reg, uint8_t value) {
+	struct nsg6502_math *m = data;
+	if (reg < 4) {
+		m->a &= ~(0xFFu << (reg * 8));
+		m->a |= (uint32_t)value << (reg * 8);
+	} else if (reg < 8) {
+		m->b &= ~(0xFFu << ((reg - 4) * 8));
+		m->b |= (uint32_t)value << ((reg - 4) * 8);
+	} else if (reg == 8) {
+		nsg6502_math_operation(m, value);
+	}
+}
+
+// Attaches m at start, with 4 ticks for a multiply and 8 for a divide. Set
+// mul_ticks and div_ticks afterwards to change that.
+static int nsg6502_math_attach(struct nsg6502_math *m, struct nsg6502_bus *b,
+							   uint16_t start) {
+	*m = (struct nsg6502_math){0};
+	m->cpu = &b->cpu;
+	m->mul_ticks = 4;
+	m->div_ticks = 8;
+	return nsg6502_bus_attach(b, start, NSG6502_MATH_REGISTERS,
+							  nsg6502_math_read, nsg6502_math_write, m);
+}
+
+#endif
@@ -0,0 +1,119 @@
+; 16 bit multiply and divide, on the coprocessor in nsg6502_math.h and in
+; plain 6502 code for machines without one. All of them take their operands
+; in NUM1 and NUM2 and leave the result in RESULT.
+
+  .org $f000
+
+MATH    = $C000                        ; Where the coprocessor is attached
+MATH_A  = MATH                         ; Operand A
+MATH_B  = MATH+4                       ; Operand B
+MATH_OP = MATH+8                       ; Operation / status
+MATH_R  = MATH+16                      ; Result
+
+NUM1    = $F0                          ; Multiplicand / dividend
+NUM2    = $F2                          ; Multiplier / divisor
+RESULT  = $F4                          ; Product, or quotient and remainder
+
+; RESULT (4 bytes) = NUM1 * NUM2
+MUL16:
+                LDA     NUM1
+                STA     MATH_A
+                LDA     NUM1+1
+                STA     MATH_A+1
+                LDA     NUM2
+                STA     MATH_B
+                LDA     NUM2+1
+                STA     MATH_B+1
+                LDA     #1             ; 16 bit multiply
+                STA     MATH_OP
+                LDA     MATH_R
+                STA     RESULT
+                LDA     MATH_R+1
+                STA     RESULT+1
+                LDA     MATH_R+2
+                STA     RESULT+2
+                LDA     MATH_R+3
+                STA     RESULT+3
+                RTS
+
+; RESULT = NUM1 / NUM2, RESULT+2 = NUM1 % NUM2
+DIV16:
+                LDA     NUM1
+                STA     MATH_A
+                LDA     NUM1+1
+                STA     MATH_A+1
+                LDA     NUM2
+                STA     MATH_B
+                LDA     NUM2+1
+                STA     MATH_B+1
+                LDA     #3             ; 16 bit divide
+                STA     MATH_OP
+                LDA     MATH_R
+                STA     RESULT
+                LDA     MATH_R+1
+                STA     RESULT+1
+                LDA     MATH_R+4
+                STA     RESULT+2
+                LDA     MATH_R+5
+                STA     RESULT+3
+                RTS
+
+; Shift and add, one multiplier bit per round. The high half of the product
+; is built in RESULT+2 and RESULT+3, the latter kept in A between rounds,
+; and shifted down into the low half.
+SWMUL16:
+                LDA     #$00
+                STA     RESULT+2
+                STA     RESULT+3
+                LDX     #16
+SWMULBIT:
+                LSR     NUM2+1         ; Next multiplier bit into carry.
+                ROR     NUM2
+                BCC     SWMULSHIFT     ; Zero, nothing to add.
+                LDA     RESULT+2
+                CLC
+                ADC     NUM1
+                STA     RESULT+2
+                LDA     RESULT+3
+                ADC     NUM1+1
+SWMULSHIFT:
+                ROR                    ; Shift the product right.
+                STA     RESULT+3
+                ROR     RESULT+2
+                ROR     RESULT+1
+                ROR     RESULT
+                DEX
+                BNE     SWMULBIT
+                RTS
+
+; Shift and subtract, one quotient bit per round. The dividend is shifted
+; out of RESULT into the remainder in RESULT+2 while the quotient is
+; shifted in behind it.
+SWDIV16:
+                LDA     NUM1
+                STA     RESULT
+                LDA     NUM1+1
+                STA     RESULT+1
+                LDA     #$00
+                STA     RESULT+2
+                STA     RESULT+3
+                LDX     #16
+SWDIVBIT:
+                ASL     RESULT
+                ROL     RESULT+1
+                ROL     RESULT+2
+                ROL     RESULT+3
+                LDA     RESULT+2       ; Does the divisor fit?
+                SEC
+                SBC     NUM2
+                TAY
+                LDA     RESULT+3
+                SBC     NUM2+1
+                BCC     SWDIVNEXT      ; No.
+                STA     RESULT+3       ; Yes, take it off and set the bit.
+                STY     RESULT+2
+                INC     RESULT
+SWDIVNEXT:
+                DEX
+                BNE     SWDIVBIT
+                RTS
@@ -0,0 +1,122 @@
+#include "nsg6502_math.h"
+#include "nsg6502_math_rom.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// usage: nsg6502_math_check [calls]
+//
+// Calls MUL16 and DIV16 from nsg6502_math.s, on the coprocessor, and the
+// plain 6502 SWMUL16 and SWDIV16 with the same random operands (200000
+// each by default), checks that both give the host's result for every call,
+// and prints the ticks and time per call of each.
+
+#define CHECK_CALL 0x0400
+#define CHECK_NUM1 0xF0
+#define CHECK_NUM2 0xF2
+#define CHECK_RESULT 0xF4
+
+static uint8_t check_memory[0x10000];
+static struct nsg6502_bus check_bus;
+static struct nsg6502_math check_math;
+
+static double check_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// JSR to the routine and run until it returns. Returns the ticks taken,
+// including the JSR.
+static size_t check_call(uint16_t routine, uint16_t a, uint16_t b) {
+	struct nsg6502_cpu *c = &check_bus.cpu;
+	check_memory[CHECK_NUM1] = a & 0xFF;
+	check_memory[CHECK_NUM1 + 1] = a >> 8;
+	check_memory[CHECK_NUM2] = b & 0xFF;
+	check_memory[CHECK_NUM2 + 1] = b >> 8;
+	check_memory[CHECK_CALL] = 0x20;
+	check_memory[CHECK_CALL + 1] = routine & 0xFF;
+	check_memory[CHECK_CALL + 2] = routine >> 8;
+	c->pc = CHECK_CALL;
+	c->sp = 0xFF;
+	size_t start = c->ticks;
+	for (size_t n = 0; c->pc != CHECK_CALL + 3; n++) {
+		if (n > 10000) {
+			fprintf(stderr, "routine at %04X did not return\n", routine);
+			exit(1);
+		}
+		nsg6502_opcode_execute(c);
+	}
+	return c->ticks - start;
+}
+
+static uint32_t check_result(void) {
+	return check_memory[CHECK_RESULT] |
+		   check_memory[CHECK_RESULT + 1] << 8 |
+		   check_memory[CHECK_RESULT + 2] << 16 |
+		   (uint32_t)check_memory[CHECK_RESULT + 3] << 24;
+}
+
+static uint16_t *check_a;
+static uint16_t *check_b;
+static uint32_t *check_results;
+
+static int check_routine(const char *name, uint16_t routine, int divide,
+						 size_t calls) {
+	size_t ticks = 0;
+	double start = check_now();
+	for (size_t i = 0; i < calls; i++) {
+		ticks += check_call(routine, check_a[i], check_b[i]);
+		check_results[i] = check_result();
+	}
+	double time = check_now() - start;
+
+	for (size_t i = 0; i < calls; i++) {
+		uint32_t a = check_a[i];
+		uint32_t b = check_b[i];
+		uint32_t want = divide ? (a / b) | (a % b) << 16 : a * b;
+		if (check_results[i] != want) {
+			fprintf(stderr, "%s: %u, %u gave %08X, want %08X\n", name, a, b,
+					check_results[i], want);
+			return 1;
+		}
+	}
+	printf("%-8s %6.1f ticks/call %6.1f ns/call\n", name,
+		   (double)ticks / calls, time * 1e9 / calls);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	size_t calls = argc > 1 ? strtoull(argv[1], NULL, 0) : 200000;
+	check_a = malloc(calls * sizeof(*check_a));
+	check_b = malloc(calls * sizeof(*check_b));
+	check_results = malloc(calls * sizeof(*check_results));
+	if (!calls || !check_a || !check_b || !check_results) {
+		fprintf(stderr, "usage: %s [calls]\n", argv[0]);
+		return 1;
+	}
+
+	nsg6502_bus_init(&check_bus, check_memory);
+	nsg6502_math_attach(&check_math, &check_bus, 0xC000);
+	memcpy(&check_memory[0xF000], nsg6502_math_rom, nsg6502_math_rom_len);
+	nsg6502_reset(&check_bus.cpu);
+
+	// Small divisors one time in eight, where the quotient is large
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < calls; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		check_a[i] = x;
+		check_b[i] = (x >> 16 & 7) == 0 ? x >> 24 : x >> 16;
+		if (!check_b[i]) {
+			check_b[i] = 1;
+		}
+	}
+
+	return check_routine("MUL16", NSG6502_MATH_ROM_MUL16, 0, calls) ||
+		   check_routine("SWMUL16", NSG6502_MATH_ROM_SWMUL16, 0, calls) ||
+		   check_routine("DIV16", NSG6502_MATH_ROM_DIV16, 1, calls) ||
+		   check_routine("SWDIV16", NSG6502_MATH_ROM_SWDIV16, 1, calls);
+}
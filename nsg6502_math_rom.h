@@ -0,0 +1,46 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// nsg6502_math.s, assembled for $F000. The routines take their operands at
+// $F0 and $F2 and leave the result at $F4, with the coprocessor at $C000.
+
+#ifndef NSG6502_MATH_ROM_H
+#define NSG6502_MATH_ROM_H
+
+#define NSG6502_MATH_ROM_MUL16 0xF000
+#define NSG6502_MATH_ROM_DIV16 0xF02E
+#define NSG6502_MATH_ROM_SWMUL16 0xF05C
+#define NSG6502_MATH_ROM_SWDIV16 0xF082
+
+static const unsigned char nsg6502_math_rom[] = {
+	0xa5, 0xf0, 0x8d, 0x00, 0xc0, 0xa5, 0xf1, 0x8d, 0x01, 0xc0, 0xa5, 0xf2,
+	0x8d, 0x04, 0xc0, 0xa5, 0xf3, 0x8d, 0x05, 0xc0, 0xa9, 0x01, 0x8d, 0x08,
+	0xc0, 0xad, 0x10, 0xc0, 0x85, 0xf4, 0xad, 0x11, 0xc0, 0x85, 0xf5, 0xad,
+	0x12, 0xc0, 0x85, 0xf6, 0xad, 0x13, 0xc0, 0x85, 0xf7, 0x60, 0xa5, 0xf0,
+	0x8d, 0x00, 0xc0, 0xa5, 0xf1, 0x8d, 0x01, 0xc0, 0xa5, 0xf2, 0x8d, 0x04,
+	0xc0, 0xa5, 0xf3, 0x8d, 0x05, 0xc0, 0xa9, 0x03, 0x8d, 0x08, 0xc0, 0xad,
+	0x10, 0xc0, 0x85, 0xf4, 0xad, 0x11, 0xc0, 0x85, 0xf5, 0xad, 0x14, 0xc0,
+	0x85, 0xf6, 0xad, 0x15, 0xc0, 0x85, 0xf7, 0x60, 0xa9, 0x00, 0x85, 0xf6,
+	0x85, 0xf7, 0xa2, 0x10, 0x46, 0xf3, 0x66, 0xf2, 0x90, 0x0b, 0xa5, 0xf6,
+	0x18, 0x65, 0xf0, 0x85, 0xf6, 0xa5, 0xf7, 0x65, 0xf1, 0x6a, 0x85, 0xf7,
+	0x66, 0xf6, 0x66, 0xf5, 0x66, 0xf4, 0xca, 0xd0, 0xe3, 0x60, 0xa5, 0xf0,
+	0x85, 0xf4, 0xa5, 0xf1, 0x85, 0xf5, 0xa9, 0x00, 0x85, 0xf6, 0x85, 0xf7,
+	0xa2, 0x10, 0x06, 0xf4, 0x26, 0xf5, 0x26, 0xf6, 0x26, 0xf7, 0xa5, 0xf6,
+	0x38, 0xe5, 0xf2, 0xa8, 0xa5, 0xf7, 0xe5, 0xf3, 0x90, 0x06, 0x85, 0xf7,
+	0x84, 0xf6, 0xe6, 0xf4, 0xca, 0xd0, 0xe3, 0x60};
+static const unsigned int nsg6502_math_rom_len = sizeof(nsg6502_math_rom);
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Banked memory controller.
+//
+// The 64 KiB address space is cut into windows of NSG6502_MMU_WINDOW_SIZE
+// bytes (4 KiB by default, define NSG6502_MMU_WINDOW_SHIFT as 13 for
+// 8 KiB). Each window shows one bank of RAM or ROM, chosen by the guest
+// writing the bank number to that window's register: register i lives at
+// registers + i, values below 0x80 select RAM bank n and values from 0x80
+// up ROM bank n - 0x80. A switch only updates the window's read and write
+// pointers, and the bus looks every access up through them. Writes to a
+// window showing ROM are dropped. A bank that does not exist maps nothing:
+// the window reads as 0 and drops writes. The registers read back what was
+// last written either way.
+//
+// Accesses to the range given to nsg6502_mmu_io() go to the host's io_read
+// and io_write instead. c->memory is not used, so neither are the recompiler,
+// snapshots or the fuzzing target, which all assume flat memory.
+
+#ifndef NSG6502_MMU_H
+#define NSG6502_MMU_H
+
+#include "nsg6502.h"
+
+#ifndef NSG6502_MMU_WINDOW_SHIFT
+#define NSG6502_MMU_WINDOW_SHIFT 12
+#endif
+#define NSG6502_MMU_WINDOW_SIZE (1 << NSG6502_MMU_WINDOW_SHIFT)
+#define NSG6502_MMU_WINDOWS (0x10000 >> NSG6502_MMU_WINDOW_SHIFT)
+#define NSG6502_MMU_ROM 0x80
+
+struct nsg6502_mmu {
+	// Has to stay first, the bus callbacks get the MMU from the CPU
+	struct nsg6502_cpu cpu;
+
+	const uint8_t *read_map[NSG6502_MMU_WINDOWS];
+	// NULL for windows showing ROM
+	uint8_t *write_map[NSG6502_MMU_WINDOWS];
+	uint8_t bank[NSG6502_MMU_WINDOWS];
+	// Windows holding the registers or part of the I/O range, only accesses
+	// to those have to check for either
+	uint8_t special[NSG6502_MMU_WINDOWS];
+
+	uint8_t *ram;
+	size_t ram_banks;
+	const uint8_t *rom;
+	size_t rom_banks;
+
+	uint16_t registers;
+
+	uint16_t io_start;
+	uint16_t io_size;
+	uint8_t (*io_read)(struct nsg6502_mmu *, uint16_t);
+	void (*io_write)(struct nsg6502_mmu *, uint16_t, uint8_t);
+	void *data;
+};
+
+// What windows without a bank read as
+static const uint8_t nsg6502_mmu_open_bus[NSG6502_MMU_WINDOW_SIZE];
+
+// Maps bank into window, or nothing if there is no such bank
+static void nsg6502_mmu_map(struct nsg6502_mmu *m, size_t window,
+							uint8_t bank) {
+	size_t n = bank & ~NSG6502_MMU_ROM;
+	m->bank[window] = bank;
+	if (bank & NSG6502_MMU_ROM ? n >= m->rom_banks : n >= m->ram_banks) {
+		m->read_map[window] = nsg6502_mmu_open_bus;
+		m->write_map[window] = NULL;
+	} else if (bank & NSG6502_MMU_ROM) {
+		m->read_map[window] = m->rom + n * NSG6502_MMU_WINDOW_SIZE;
+		m->write_map[window] = NULL;
+	} else {
+		m->write_map[window] = m->ram + n * NSG6502_MMU_WINDOW_SIZE;
+		m->read_map[window] = m->write_map[window];
+	}
+}
+
+static void nsg6502_mmu_mark(struct nsg6502_mmu *m, uint16_t start,
+							 uint32_t size) {
+	for (uint32_t a = start; a < (uint32_t)start + size; a++) {
+		m->special[(a & 0xFFFF) >> NSG6502_MMU_WINDOW_SHIFT] = 1;
+	}
+}
+
+static uint8_t nsg6502_mmu_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_mmu *m = (struct nsg6502_mmu *)c;
+	size_t window = addr >> NSG6502_MMU_WINDOW_SHIFT;
+	if (!m->special[window]) {
+		return m->read_map[window][addr & (NSG6502_MMU_WINDOW_SIZE - 1)];
+	}
+	if ((uint16_t)(addr - m->io_start) < m->io_size) {
+		return m->io_read(m, addr);
+	}
+	if ((uint16_t)(addr - m->registers) < NSG6502_MMU_WINDOWS) {
+		return m->bank[addr - m->registers];
+	}
+	return m->read_map[window][addr & (NSG6502_MMU_WINDOW_SIZE - 1)];
+}
+
+static void nsg6502_mmu_write(struct nsg6502_cpu *c, uint16_t addr,
+							  uint8_t data) {
+	struct nsg6502_mmu *m = (struct nsg6502_mmu *)c;
+	size_t window = addr >> NSG6502_MMU_WINDOW_SHIFT;
+	if (m->special[window]) {
+		if ((uint16_t)(addr - m->io_start) < m->io_size) {
+			m->io_write(m, addr, data);
+			return;
+		}
+		if ((uint16_t)(addr - m->registers) < NSG6502_MMU_WINDOWS) {
+			nsg6502_mmu_map(m, addr - m->registers, data);
+			return;
+		}
+	}
+	uint8_t *p = m->write_map[window];
+	if (p) {
+		p[addr & (NSG6502_MMU_WINDOW_SIZE - 1)] = data;
+	}
+}
+
+// ram and rom hold ram_banks and rom_banks banks of NSG6502_MMU_WINDOW_SIZE
+// bytes. Windows start out showing RAM banks 0 to NSG6502_MMU_WINDOWS - 1,
+// as far as there are any, and read as 0 otherwise. Then the last window is
+// switched to the last ROM bank so the vectors come from ROM. Callbacks are
+// set up, the I/O range and reset are left to the host; call
+// nsg6502_mmu_io() to set the former.
+static void nsg6502_mmu_init(struct nsg6502_mmu *m, uint8_t *ram,
+							 size_t ram_banks, const uint8_t *rom,
+							 size_t rom_banks, uint16_t registers) {
+	*m = (struct nsg6502_mmu){0};
+	m->cpu.memory_read_callback = nsg6502_mmu_read;
+	m->cpu.memory_write_callback = nsg6502_mmu_write;
+	m->ram = ram;
+	m->ram_banks = ram_banks < NSG6502_MMU_ROM ? ram_banks : NSG6502_MMU_ROM;
+	m->rom = rom;
+	m->rom_banks = rom_banks < NSG6502_MMU_ROM ? rom_banks : NSG6502_MMU_ROM;
+	m->registers = registers;
+	nsg6502_mmu_mark(m, registers, NSG6502_MMU_WINDOWS);
+	for (size_t i = 0; i < NSG6502_MMU_WINDOWS; i++) {
+		nsg6502_mmu_map(m, i, i);
+	}
+	if (m->rom_banks) {
+		nsg6502_mmu_map(m, NSG6502_MMU_WINDOWS - 1,
+						NSG6502_MMU_ROM | (m->rom_banks - 1));
+	}
+}
+
+// Sends [start, start + size) to io_read and io_write
+static void nsg6502_mmu_io(struct nsg6502_mmu *m, uint16_t start,
+						   uint16_t size,
+						   uint8_t (*io_read)(struct nsg6502_mmu *, uint16_t),
+						   void (*io_write)(struct nsg6502_mmu *, uint16_t,
+											uint8_t)) {
+	m->io_start = start;
+	m->io_size = size;
+	m->io_read = io_read;
+	m->io_write = io_write;
+	nsg6502_mmu_mark(m, start, size);
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Consistent views of a running CPU for other threads.
+//
+// The emulator thread calls nsg6502_observe_publish between instructions
+// to copy the registers and a few watched ranges of guest memory into the
+// observer under a sequence lock: the sequence is odd while a copy is in
+// progress and goes up by two with every publish. It never waits for
+// anyone. Readers copy the lot out and try again if the sequence was odd
+// or moved meanwhile, so what they get is always one instruction
+// boundary, never half of two. The struct holds no pointers and can live
+// in memory shared with other processes as well.
+
+#ifndef NSG6502_OBSERVE_H
+#define NSG6502_OBSERVE_H
+
+#include "nsg6502.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define NSG6502_OBSERVE_RANGES 8
+#define NSG6502_OBSERVE_BYTES 1024
+
+struct nsg6502_observe_regs {
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t sp;
+	uint8_t status;
+	uint16_t pc;
+	uint64_t ticks;
+};
+
+struct nsg6502_observe_range {
+	uint16_t start;
+	uint16_t size;
+	// Where the copy starts in data
+	uint16_t offset;
+};
+
+struct nsg6502_observer {
+	// Only the emulator thread touches these
+	struct nsg6502_observe_range ranges[NSG6502_OBSERVE_RANGES];
+	size_t range_count;
+	size_t used;
+	// Ticks between publishes for nsg6502_observe_step
+	size_t interval;
+	size_t next;
+
+	// Its own cache line, readers poll it
+	_Alignas(64) atomic_uint_fast64_t sequence;
+	struct nsg6502_observe_regs regs;
+	uint8_t data[NSG6502_OBSERVE_BYTES];
+};
+
+// interval is how many ticks nsg6502_observe_step lets pass between
+// publishes, 0 to publish on every call
+static void nsg6502_observe_init(struct nsg6502_observer *o,
+								 size_t interval) {
+	memset(o, 0, sizeof(*o));
+	o->interval = interval;
+	atomic_init(&o->sequence, 0);
+}
+
+// Adds a range of guest memory to copy on every publish. Returns the offset
+// of its copy in the data readers get, or -1 when there is no room. Add all
+// ranges before the first publish.
+static int nsg6502_observe_watch(struct nsg6502_observer *o, uint16_t start,
+								 uint16_t size) {
+	if (o->range_count == NSG6502_OBSERVE_RANGES ||
+		size > NSG6502_OBSERVE_BYTES - o->used ||
+		(uint32_t)start + size > 0x10000) {
+		return -1;
+	}
+	struct nsg6502_observe_range *r = &o->ranges[o->range_count++];
+	r->start = start;
+	r->size = size;
+	r->offset = o->used;
+	o->used += size;
+	return r->offset;
+}
+
+// Copies the registers and watched memory. Only call it from the thread
+// running c, between instructions. Memory is read from c->memory, not
+// through the bus callbacks, so devices see no extra reads. Returns -1 and
+// publishes nothing when ranges are watched but c has no memory array.
+static int nsg6502_observe_publish(struct nsg6502_observer *o,
+								   struct nsg6502_cpu *c) {
+	if (o->range_count && !c->memory) {
+		return -1;
+	}
+	nsg6502_flags_resolve(c);
+
+	uint64_t sequence =
+		atomic_load_explicit(&o->sequence, memory_order_relaxed);
+	atomic_store_explicit(&o->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	o->regs.a = c->a;
+	o->regs.x = c->x;
+	o->regs.y = c->y;
+	o->regs.sp = c->sp;
+	o->regs.status = c->status;
+	o->regs.pc = c->pc;
+	o->regs.ticks = c->ticks;
+	for (size_t i = 0; i < o->range_count; i++) {
+		const struct nsg6502_observe_range *r = &o->ranges[i];
+		memcpy(o->data + r->offset, c->memory + r->start, r->size);
+	}
+
+	atomic_store_explicit(&o->sequence, sequence + 2, memory_order_release);
+	o->next = c->ticks + o->interval;
+	return 0;
+}
+
+// Publishes if interval ticks have passed since the last time, cheap enough
+// to call after every instruction. Returns what nsg6502_observe_publish
+// did, 0 when it was not due.
+static inline int nsg6502_observe_step(struct nsg6502_observer *o,
+									   struct nsg6502_cpu *c) {
+	if (c->ticks >= o->next) {
+		return nsg6502_observe_publish(o, c);
+	}
+	return 0;
+}
+
+// Takes one try at a copy from any thread. data gets the first size bytes
+// of the watched memory, at the offsets nsg6502_observe_watch returned;
+// either may be NULL. Returns the publish it copied, counting from 1, 0 if
+// nothing was published yet, or -1 if a publish got in the way.
+static int64_t nsg6502_observe_try_read(struct nsg6502_observer *o,
+										struct nsg6502_observe_regs *regs,
+										uint8_t *data, size_t size) {
+	uint64_t sequence =
+		atomic_load_explicit(&o->sequence, memory_order_acquire);
+	if (sequence & 1) {
+		return -1;
+	}
+	if (regs) {
+		memcpy(regs, &o->regs, sizeof(*regs));
+	}
+	if (data) {
+		memcpy(data, o->data,
+			   size < NSG6502_OBSERVE_BYTES ? size : NSG6502_OBSERVE_BYTES);
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&o->sequence, memory_order_relaxed) != sequence) {
+		return -1;
+	}
+	return sequence / 2;
+}
+
+// Keeps trying until a copy is whole and returns what
+// nsg6502_observe_try_read did, never -1. A publish copies little, so this
+// only yields while one is in progress.
+static int64_t nsg6502_observe_read(struct nsg6502_observer *o,
+									struct nsg6502_observe_regs *regs,
+									uint8_t *data, size_t size) {
+	int64_t n;
+	while ((n = nsg6502_observe_try_read(o, regs, data, size)) < 0) {
+		sched_yield();
+	}
+	return n;
+}
+
+#endif
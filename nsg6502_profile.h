@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Opcode sequence profile.
+//
+// Counts how often each opcode pair and triple runs back to back, for
+// nsg6502_fuse to pick superinstructions from. The host calls
+// nsg6502_profile_step() before every nsg6502_opcode_execute(); the opcode
+// is read straight from c->memory, so code has to live there. Profiles are
+// text, one "pair" or "triple" line per sequence with its count, and can be
+// added up across runs with nsg6502_profile_load().
+
+#ifndef NSG6502_PROFILE_H
+#define NSG6502_PROFILE_H
+
+#include "nsg6502.h"
+#include <stdio.h>
+#include <string.h>
+
+// Distinct triples kept, later ones are not counted once it is full
+#define NSG6502_PROFILE_TRIPLES 0x10000
+
+struct nsg6502_profile_triple {
+	// The three opcodes, first one in the top byte, plus 1 << 24 when used
+	uint32_t key;
+	uint64_t count;
+};
+
+struct nsg6502_profile {
+	uint64_t pairs[0x10000];
+	struct nsg6502_profile_triple triples[NSG6502_PROFILE_TRIPLES];
+	size_t triple_count;
+	uint64_t instructions;
+	// The last opcodes run, the latest in the low byte
+	uint32_t history;
+};
+
+static void nsg6502_profile_init(struct nsg6502_profile *p) {
+	memset(p, 0, sizeof(*p));
+}
+
+static void nsg6502_profile_add_triple(struct nsg6502_profile *p,
+									   uint32_t triple, uint64_t count) {
+	uint32_t key = (triple & 0xFFFFFF) | (1 << 24);
+	size_t i = (key * 2654435761u) >> 16;
+	for (size_t n = 0; n < NSG6502_PROFILE_TRIPLES; n++) {
+		struct nsg6502_profile_triple *t =
+			&p->triples[(i + n) % NSG6502_PROFILE_TRIPLES];
+		if (t->key == key) {
+			t->count += count;
+			return;
+		}
+		if (!t->key) {
+			// Leave one slot free so that lookups always end
+			if (p->triple_count == NSG6502_PROFILE_TRIPLES - 1) {
+				return;
+			}
+			t->key = key;
+			t->count = count;
+			p->triple_count++;
+			return;
+		}
+	}
+}
+
+static uint64_t nsg6502_profile_triple(struct nsg6502_profile *p,
+									   uint32_t triple) {
+	uint32_t key = (triple & 0xFFFFFF) | (1 << 24);
+	size_t i = (key * 2654435761u) >> 16;
+	for (size_t n = 0; n < NSG6502_PROFILE_TRIPLES; n++) {
+		struct nsg6502_profile_triple *t =
+			&p->triples[(i + n) % NSG6502_PROFILE_TRIPLES];
+		if (t->key == key) {
+			return t->count;
+		}
+		if (!t->key) {
+			break;
+		}
+	}
+	return 0;
+}
+
+// Counts the instruction at c->pc, which is about to run
+static void nsg6502_profile_step(struct nsg6502_profile *p,
+								 struct nsg6502_cpu *c) {
+	p->history = (p->history << 8) | c->memory[c->pc];
+	p->instructions++;
+	if (p->instructions >= 2) {
+		p->pairs[p->history & 0xFFFF]++;
+	}
+	if (p->instructions >= 3) {
+		nsg6502_profile_add_triple(p, p->history, 1);
+	}
+}
+
+static int nsg6502_profile_save(struct nsg6502_profile *p, FILE *f) {
+	fprintf(f, "instructions %llu\n", (unsigned long long)p->instructions);
+	for (size_t i = 0; i < 0x10000; i++) {
+		if (p->pairs[i]) {
+			fprintf(f, "pair %02zX %02zX %llu\n", i >> 8, i & 0xFF,
+					(unsigned long long)p->pairs[i]);
+		}
+	}
+	for (size_t i = 0; i < NSG6502_PROFILE_TRIPLES; i++) {
+		struct nsg6502_profile_triple *t = &p->triples[i];
+		if (t->key) {
+			fprintf(f, "triple %02X %02X %02X %llu\n", (t->key >> 16) & 0xFF,
+					(t->key >> 8) & 0xFF, t->key & 0xFF,
+					(unsigned long long)t->count);
+		}
+	}
+	return ferror(f) ? -1 : 0;
+}
+
+// Adds a saved profile to p. Returns -1 on a malformed line.
+static int nsg6502_profile_load(struct nsg6502_profile *p, FILE *f) {
+	char kind[16];
+	unsigned int op[3];
+	unsigned long long count;
+	while (fscanf(f, "%15s", kind) == 1) {
+		if (!strcmp(kind, "instructions") && fscanf(f, "%llu", &count) == 1) {
+			p->instructions += count;
+		} else if (!strcmp(kind, "pair") &&
+				   fscanf(f, "%x %x %llu", &op[0], &op[1], &count) == 3 &&
+				   op[0] < 0x100 && op[1] < 0x100) {
+			p->pairs[(op[0] << 8) | op[1]] += count;
+		} else if (!strcmp(kind, "triple") &&
+				   fscanf(f, "%x %x %x %llu", &op[0], &op[1], &op[2],
+						  &count) == 4 &&
+				   op[0] < 0x100 && op[1] < 0x100 && op[2] < 0x100) {
+			nsg6502_profile_add_triple(p, (op[0] << 16) | (op[1] << 8) | op[2],
+									   count);
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#endif
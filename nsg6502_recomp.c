@@ -0,0 +1,56 @@
+#include "nsg6502_recomp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// usage: nsg6502_recomp <rom> <load address> [reset] [irq] [nmi] > out.h
+//
+// Vectors that are not given are read from the image, which then has to
+// cover $FFFA-$FFFF. The output is meant to be included after nsg6502.h,
+// e.g. cc -DNSG6502_RECOMP='"out.h"' main.c
+
+static struct nsg6502_recomp recomp;
+static uint8_t rom[0x10000];
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr,
+				"usage: %s <rom> <load address> [reset] [irq] [nmi]\n",
+				argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	size_t size = fread(rom, 1, sizeof(rom), f);
+	fclose(f);
+
+	uint16_t start = strtoul(argv[2], NULL, 16);
+	if (start + size > 0x10000) {
+		fprintf(stderr, "%s: image does not fit at $%04X\n", argv[1], start);
+		return 1;
+	}
+
+	// NMI, reset and IRQ/BRK, in vector order
+	uint16_t entries[3];
+	const int arg_for_vector[3] = {5, 3, 4};
+	for (int i = 0; i < 3; i++) {
+		uint16_t vector = 0xFFFA + i * 2;
+		if (argc > arg_for_vector[i]) {
+			entries[i] = strtoul(argv[arg_for_vector[i]], NULL, 16);
+		} else if (vector >= start && (size_t)vector + 1 < start + size) {
+			entries[i] =
+				rom[vector - start] | (rom[vector + 1 - start] << 8);
+		} else {
+			fprintf(stderr, "%s: no vector at $%04X, pass it explicitly\n",
+					argv[1], vector);
+			return 1;
+		}
+	}
+
+	nsg6502_recomp_analyze(&recomp, rom, start, size, entries, 3);
+	nsg6502_recomp_emit(&recomp, stdout, argv[1]);
+	return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Ahead-of-time translation of a ROM image to C.
+//
+// Control flow is recovered from the reset/IRQ/NMI vectors by following
+// branches, JSR and JMP targets. Every reachable instruction becomes a
+// labelled block of C: branches, JMP and the simple immediate, zero page
+// and absolute ops are emitted with their operand folded in, everything
+// else calls its NSG6502_OPCODES handler. Data accesses and flags go
+// through the same bus and flag helpers as the interpreter, while opcode
+// fetch, operand fetch and dispatch go away. Anything that cannot be
+// followed statically (RTS, RTI, JMP (ind), BRK, code outside the image)
+// goes back through a switch on the PC, which falls back to
+// nsg6502_opcode_execute for addresses that were never translated. An
+// instruction any byte of which has changed in memory is also handed to
+// the interpreter, unless NSG6502_RECOMP_TRUST_ROM is set when compiling
+// the generated code. Interrupt lines are sampled at every jump target; a
+// pending interrupt is taken by the interpreter, which then resumes in
+// translated code at the handler.
+
+#ifndef NSG6502_RECOMP_H
+#define NSG6502_RECOMP_H
+
+#include "nsg6502.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NSG6502_RECOMP_INSN (1 << 0)
+#define NSG6502_RECOMP_LABEL (1 << 1)
+
+struct nsg6502_recomp {
+	uint8_t image[0x10000];
+	uint16_t start;
+	uint32_t size;
+
+	uint8_t flags[0x10000];
+	uint16_t worklist[0x10000];
+	size_t pending;
+};
+
+static int nsg6502_recomp_in_image(struct nsg6502_recomp *r, uint16_t addr) {
+	return (uint32_t)(uint16_t)(addr - r->start) < r->size;
+}
+
+// Instruction length, derived from the addressing mode in the table name
+static uint8_t nsg6502_recomp_length(uint8_t op) {
+	const char *name = NSG6502_OPCODES[op].name;
+	if (!name) {
+		return 1;
+	}
+
+	const char *mode = strchr(name, ' ');
+	if (!mode || !strcmp(mode, " A")) {
+		return 1;
+	}
+	if (!strncmp(mode, " ABS", 4) || !strncmp(mode, " ABX", 4) ||
+		!strncmp(mode, " ABY", 4) || !strcmp(mode, " IND") ||
+		!strcmp(mode, " IAX")) {
+		return 3;
+	}
+	return 2;
+}
+
+static int nsg6502_recomp_is_branch(uint8_t op) {
+#ifdef NSG6502_65C02
+	if (op == 0x80) {
+		return 1;
+	}
+#endif
+	return (op & 0x1F) == 0x10;
+}
+
+// Instructions after which the next one is not known: returns, indirect
+// jumps and, on the 65C02, WAI and STP, which stop until the host steps in
+static int nsg6502_recomp_ends_flow(uint8_t op) {
+#ifdef NSG6502_65C02
+	if (op == 0x7C || op == 0xCB || op == 0xDB) {
+		return 1;
+	}
+#endif
+	return op == 0x00 || op == 0x40 || op == 0x60 || op == 0x6C;
+}
+
+static void nsg6502_recomp_add(struct nsg6502_recomp *r, uint16_t addr) {
+	r->flags[addr] |= NSG6502_RECOMP_LABEL;
+	if (nsg6502_recomp_in_image(r, addr) &&
+		!(r->flags[addr] & NSG6502_RECOMP_INSN)) {
+		r->worklist[r->pending++] = addr;
+	}
+}
+
+static uint16_t nsg6502_recomp_operand(struct nsg6502_recomp *r,
+									   uint16_t addr) {
+	return r->image[(uint16_t)(addr + 1)] |
+		   (r->image[(uint16_t)(addr + 2)] << 8);
+}
+
+// The instruction at addr as it was translated, first byte lowest
+static uint32_t nsg6502_recomp_bytes(struct nsg6502_recomp *r,
+									 uint16_t addr) {
+	uint32_t bytes = 0;
+	for (int i = nsg6502_recomp_length(r->image[addr]) - 1; i >= 0; i--) {
+		bytes = bytes << 8 | r->image[(uint16_t)(addr + i)];
+	}
+	return bytes;
+}
+
+static uint16_t nsg6502_recomp_branch_target(struct nsg6502_recomp *r,
+											 uint16_t addr) {
+	return addr + 2 + (int8_t)r->image[(uint16_t)(addr + 1)];
+}
+
+// Loads size bytes of rom at start and marks everything reachable from the
+// given entry points
+static void nsg6502_recomp_analyze(struct nsg6502_recomp *r,
+								   const uint8_t *rom, uint16_t start,
+								   uint32_t size, const uint16_t *entries,
+								   size_t entry_count) {
+	memset(r->flags, 0, sizeof(r->flags));
+	r->start = start;
+	r->size = size;
+	r->pending = 0;
+	for (uint32_t i = 0; i < size; i++) {
+		r->image[(uint16_t)(start + i)] = rom[i];
+	}
+
+	for (size_t i = 0; i < entry_count; i++) {
+		nsg6502_recomp_add(r, entries[i]);
+	}
+
+	while (r->pending) {
+		uint16_t addr = r->worklist[--r->pending];
+		while (nsg6502_recomp_in_image(r, addr) &&
+			   !(r->flags[addr] & NSG6502_RECOMP_INSN)) {
+			uint8_t op = r->image[addr];
+			uint16_t next = addr + nsg6502_recomp_length(op);
+			r->flags[addr] |= NSG6502_RECOMP_INSN;
+
+			if (nsg6502_recomp_ends_flow(op)) {
+				break;
+			}
+			if (op == 0x4C) {
+				nsg6502_recomp_add(r, nsg6502_recomp_operand(r, addr));
+				break;
+			}
+			if (op == 0x20) {
+				nsg6502_recomp_add(r, nsg6502_recomp_operand(r, addr));
+				nsg6502_recomp_add(r, next);
+			}
+			if (nsg6502_recomp_is_branch(op)) {
+				nsg6502_recomp_add(r, nsg6502_recomp_branch_target(r, addr));
+#ifdef NSG6502_65C02
+				if (op == 0x80) {
+					break;
+				}
+#endif
+				nsg6502_recomp_add(r, next);
+			}
+			addr = next;
+		}
+	}
+}
+
+// Operations that only need their operand value, and how to apply it
+static const char *const NSG6502_RECOMP_VALUE_OPS[][2] = {
+	{"LDA", "\tc->a = %s;\n\tnsg6502_evaluate_flags(c, c->a);\n"},
+	{"LDX", "\tc->x = %s;\n\tnsg6502_evaluate_flags(c, c->x);\n"},
+	{"LDY", "\tc->y = %s;\n\tnsg6502_evaluate_flags(c, c->y);\n"},
+	{"ORA", "\tc->a |= %s;\n\tnsg6502_evaluate_flags(c, c->a);\n"},
+	{"AND", "\tc->a &= %s;\n\tnsg6502_evaluate_flags(c, c->a);\n"},
+	{"EOR", "\tc->a ^= %s;\n\tnsg6502_evaluate_flags(c, c->a);\n"},
+	// These read the carry, pending lazy flags have to be settled first
+	{"ADC", "\tnsg6502_flags_resolve(c);\n\tnsg6502_adc(c, %s);\n"},
+	{"SBC", "\tnsg6502_flags_resolve(c);\n\tnsg6502_sbc(c, %s);\n"},
+	{"CMP", "\tnsg6502_compare(c, c->a, %s);\n"},
+	{"CPX", "\tnsg6502_compare(c, c->x, %s);\n"},
+	{"CPY", "\tnsg6502_compare(c, c->y, %s);\n"},
+	{"STA", "\tnsg6502_write_byte(c, %s, c->a);\n"},
+	{"STX", "\tnsg6502_write_byte(c, %s, c->x);\n"},
+	{"STY", "\tnsg6502_write_byte(c, %s, c->y);\n"},
+};
+
+static const char *const NSG6502_RECOMP_BRANCHES[8] = {
+	"!nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_NEGATIVE)",
+	"nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_NEGATIVE)",
+	"!nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_OVERFLOW)",
+	"nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_OVERFLOW)",
+	"!nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_CARRY)",
+	"nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_CARRY)",
+	"!nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_ZERO)",
+	"nsg6502_flag_test(c, NSG6502_STATUS_REGISTER_ZERO)",
+};
+
+static const char *nsg6502_recomp_branch_condition(uint8_t op) {
+#ifdef NSG6502_65C02
+	if (op == 0x80) {
+		return "1";
+	}
+#endif
+	return NSG6502_RECOMP_BRANCHES[op >> 5];
+}
+
+// Emits the instruction with its operand folded in, for the immediate,
+// zero page and absolute forms of the simple load/store/ALU ops. Data
+// accesses still go through the bus; only the operand fetch is skipped, and
+// its ticks are charged up front like the handler would. Returns 0 when
+// the instruction has to go through its handler instead.
+static int nsg6502_recomp_emit_folded(struct nsg6502_recomp *r, FILE *out,
+									  uint16_t addr, uint8_t op) {
+	const char *name = NSG6502_OPCODES[op].name;
+	if (!name || !NSG6502_OPCODES[op].function) {
+		return 0;
+	}
+
+	const char *mode = strchr(name, ' ');
+	if (!mode) {
+		return 0;
+	}
+
+	char operand[32];
+	uint8_t length = nsg6502_recomp_length(op);
+	int store = name[0] == 'S' && name[1] == 'T';
+	if (!strcmp(mode, " #") && !store) {
+		snprintf(operand, sizeof(operand), "0x%02X",
+				 r->image[(uint16_t)(addr + 1)]);
+	} else if (!strcmp(mode, " ZP") || !strcmp(mode, " ABS")) {
+		uint16_t ea = length == 2 ? r->image[(uint16_t)(addr + 1)]
+								  : nsg6502_recomp_operand(r, addr);
+		snprintf(operand, sizeof(operand),
+				 store ? "0x%04X" : "nsg6502_read_byte(c, 0x%04X)", ea);
+	} else {
+		return 0;
+	}
+
+	for (size_t i = 0; i < sizeof(NSG6502_RECOMP_VALUE_OPS) /
+							   sizeof(NSG6502_RECOMP_VALUE_OPS[0]);
+		 i++) {
+		if (!strncmp(name, NSG6502_RECOMP_VALUE_OPS[i][0], 3)) {
+			fprintf(out, "\tc->pc = 0x%04X;\n", (uint16_t)(addr + length));
+			fprintf(out, "\tc->ticks += %d + NSG6502_OPCODES[0x%02X].ticks;\n",
+					length, op);
+			fprintf(out, NSG6502_RECOMP_VALUE_OPS[i][1], operand);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void nsg6502_recomp_emit_goto(struct nsg6502_recomp *r, FILE *out,
+									 uint16_t addr) {
+	if (r->flags[addr] & NSG6502_RECOMP_INSN) {
+		fprintf(out, "\tif (c->pc == 0x%04X) {\n\t\tgoto L_%04X;\n\t}\n", addr,
+				addr);
+	}
+}
+
+// Writes nsg6502_recomp_run() to out. It runs the guest until at least
+// budget ticks have passed, checking the budget at every jump target.
+static void nsg6502_recomp_emit(struct nsg6502_recomp *r, FILE *out,
+								const char *source) {
+	fprintf(out, "// Generated by nsg6502_recomp from %s, do not edit\n\n",
+			source);
+	// Every byte of an instruction is compared, operands and targets are
+	// folded into the code as well
+	fprintf(out, "#ifdef NSG6502_RECOMP_TRUST_ROM\n"
+				 "#define NSG6502_RECOMP_CHECK(addr, length, bytes) 1\n"
+				 "#else\n"
+				 "#define NSG6502_RECOMP_CHECK(addr, length, bytes) "
+				 "nsg6502_recomp_matches(c, addr, length, bytes)\n"
+				 "#endif\n\n"
+				 "static inline int nsg6502_recomp_matches("
+				 "struct nsg6502_cpu *c, uint16_t addr,\n"
+				 "\t\t\t\t\t\t\t\t\t\t  int length, uint32_t bytes) {\n"
+				 "\tfor (int i = 0; i < length; i++) {\n"
+				 "\t\tif (c->memory[(uint16_t)(addr + i)] != "
+				 "(uint8_t)(bytes >> (i * 8))) {\n"
+				 "\t\t\treturn 0;\n\t\t}\n\t}\n"
+				 "\treturn 1;\n}\n\n");
+	// Taken the same way nsg6502_opcode_execute would take it
+	fprintf(out, "#define NSG6502_RECOMP_INTERRUPT \\\n"
+				 "\t(c->nmi || (c->irq && !NSG6502_FLAG_IS_SET(c->status, \\\n"
+				 "\t\tNSG6502_STATUS_REGISTER_INTERRUPT_DISABLE)))\n\n");
+	fprintf(out, "static void nsg6502_recomp_run(struct nsg6502_cpu *c, "
+				 "size_t budget) {\n"
+				 "\tsize_t limit = c->ticks + budget;\n"
+				 "\tgoto dispatch;\n\n");
+
+	uint32_t expected = 0x10000;
+	for (uint32_t addr = 0; addr < 0x10000; addr++) {
+		if (!(r->flags[addr] & NSG6502_RECOMP_INSN)) {
+			continue;
+		}
+
+		uint8_t op = r->image[addr];
+		uint16_t next = addr + nsg6502_recomp_length(op);
+
+		if (expected != 0x10000 && expected != addr) {
+			nsg6502_recomp_emit_goto(r, out, expected);
+			fprintf(out, "\tgoto dispatch;\n");
+		}
+
+		fprintf(out, "L_%04X: // %s\n", addr,
+				NSG6502_OPCODES[op].name ? NSG6502_OPCODES[op].name : "???");
+		if (r->flags[addr] & NSG6502_RECOMP_LABEL) {
+			fprintf(out, "\tif (c->ticks >= limit) {\n\t\treturn;\n\t}\n"
+						 "\tif (NSG6502_RECOMP_INTERRUPT) {\n"
+						 "\t\tgoto dispatch;\n\t}\n");
+		}
+		fprintf(out,
+				"\tif (!NSG6502_RECOMP_CHECK(0x%04X, %d, 0x%06X)) {\n"
+				"\t\tgoto dispatch;\n\t}\n",
+				addr, nsg6502_recomp_length(op),
+				nsg6502_recomp_bytes(r, addr));
+		if (nsg6502_recomp_is_branch(op)) {
+			// Taken branches fetch their offset, untaken ones skip it
+			uint16_t target = nsg6502_recomp_branch_target(r, addr);
+			fprintf(out,
+					"\tc->ticks += 1 + NSG6502_OPCODES[0x%02X].ticks;\n"
+					"\tif (%s) {\n\t\tc->ticks++;\n\t\tc->pc = 0x%04X;\n",
+					op, nsg6502_recomp_branch_condition(op), target);
+			if (r->flags[target] & NSG6502_RECOMP_INSN) {
+				fprintf(out, "\t\tgoto L_%04X;\n", target);
+			} else {
+				fprintf(out, "\t\tgoto dispatch;\n");
+			}
+			fprintf(out, "\t}\n\tc->pc = 0x%04X;\n", (uint16_t)(next));
+			nsg6502_recomp_emit_goto(r, out, next);
+			fprintf(out, "\tgoto dispatch;\n\n");
+			expected = 0x10000;
+			continue;
+		}
+		if (op == 0x4C) {
+			uint16_t target = nsg6502_recomp_operand(r, addr);
+			fprintf(out,
+					"\tc->ticks += 3 + NSG6502_OPCODES[0x4C].ticks;\n"
+					"\tc->pc = 0x%04X;\n",
+					target);
+			nsg6502_recomp_emit_goto(r, out, target);
+			fprintf(out, "\tgoto dispatch;\n\n");
+			expected = 0x10000;
+			continue;
+		}
+		if (nsg6502_recomp_emit_folded(r, out, addr, op)) {
+			fprintf(out, "\n");
+			expected = next;
+			continue;
+		}
+
+		// The opcode is fetched, the handler takes it from there, resolving
+		// lazy flags first if it needs them
+		fprintf(out,
+				"\tc->pc = 0x%04X;\n"
+				"\tc->ticks += 1;\n"
+				"\tnsg6502_opcode_dispatch(c, 0x%02X);\n",
+				(uint16_t)(addr + 1), op);
+
+		expected = next;
+		if (nsg6502_recomp_ends_flow(op)) {
+			fprintf(out, "\tgoto dispatch;\n");
+			expected = 0x10000;
+		} else if (op == 0x20) {
+			// A trap returns straight away, so the PC is not always the target
+			nsg6502_recomp_emit_goto(r, out, nsg6502_recomp_operand(r, addr));
+			fprintf(out, "\tgoto dispatch;\n");
+			expected = 0x10000;
+		}
+		fprintf(out, "\n");
+	}
+	if (expected != 0x10000) {
+		nsg6502_recomp_emit_goto(r, out, expected);
+		fprintf(out, "\tgoto dispatch;\n\n");
+	}
+
+	fprintf(out, "dispatch:\n"
+				 "\tif (c->ticks >= limit) {\n\t\treturn;\n\t}\n");
+#ifdef NSG6502_65C02
+	// A CPU stopped by WAI or STP waits in the interpreter
+	fprintf(out, "\tif (c->halt) {\n"
+				 "\t\tnsg6502_opcode_execute(c);\n"
+				 "\t\tgoto dispatch;\n\t}\n");
+#endif
+	fprintf(out, "\tif (NSG6502_RECOMP_INTERRUPT) {\n"
+				 "\t\tnsg6502_opcode_execute(c);\n"
+				 "\t\tgoto dispatch;\n\t}\n");
+	fprintf(out, "\tswitch (c->pc) {\n");
+	for (uint32_t addr = 0; addr < 0x10000; addr++) {
+		if (r->flags[addr] & NSG6502_RECOMP_INSN) {
+			fprintf(out,
+					"\t\tcase 0x%04X:\n"
+					"\t\t\tif (NSG6502_RECOMP_CHECK(0x%04X, %d, 0x%06X)) {\n"
+					"\t\t\t\tgoto L_%04X;\n\t\t\t}\n\t\t\tbreak;\n",
+					addr, addr, nsg6502_recomp_length(r->image[addr]),
+					nsg6502_recomp_bytes(r, addr), addr);
+		}
+	}
+	fprintf(out, "\t}\n"
+				 "\tnsg6502_opcode_execute(c);\n"
+				 "\tgoto dispatch;\n"
+				 "}\n");
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include "nsg6502.h"
+#include "wozmon.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// usage: nsg6502_recomp_check [input]
+//
+// Runs the same wozmon session in the interpreter and in the recompiled
+// code and compares every byte written to the console and the tick it was
+// written on. Build it with the nsg6502_recomp output for wozmon.h's image,
+// once per combination of NSG6502_LAZY_FLAGS, NSG6502_TABLE_ALU and so on
+// to check, e.g.
+// nsg6502_recomp wozmon.bin FF00 FF00 0000 0F00 > wozmon_recomp.h
+// cc -DNSG6502_RECOMP='"wozmon_recomp.h"' nsg6502_recomp_check.c
+// The default session dumps the ROM, which takes PRHEX's ADC after a CMP,
+// and then patches the operand of wozmon's LDA #':' so translated code has
+// to notice its operand changed. In the input, '\n' stands for a return.
+
+#include NSG6502_RECOMP
+
+#define CHECK_MAX_WRITES 65536
+
+struct check_machine {
+	// Has to stay first, the callbacks get the rest from the CPU
+	struct nsg6502_cpu cpu;
+	const char *input;
+	size_t position;
+	int done;
+
+	uint8_t output[CHECK_MAX_WRITES];
+	size_t ticks[CHECK_MAX_WRITES];
+	size_t count;
+
+	uint8_t memory[0x10000];
+};
+
+static void check_write(struct nsg6502_cpu *c, uint16_t addr, uint8_t data) {
+	struct check_machine *m = (struct check_machine *)c;
+	// Recompiled code runs on to the end of its slice after the input ran
+	// out, what it writes then is not compared
+	if (addr == 0x200 && !m->done && m->count < CHECK_MAX_WRITES) {
+		m->output[m->count] = data;
+		m->ticks[m->count++] = c->ticks;
+	}
+	c->memory[addr] = data;
+}
+
+static uint8_t check_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct check_machine *m = (struct check_machine *)c;
+	if (addr == 0x201) {
+		char k = m->input[m->position];
+		if (!k) {
+			m->done = 1;
+			return 0;
+		}
+		m->position++;
+		return k == '\n' ? '\r' : k;
+	}
+	if (addr == 0x202) {
+		return 1;
+	}
+	return c->memory[addr];
+}
+
+static void check_boot(struct check_machine *m, const char *input) {
+	memset(m, 0, sizeof(*m));
+	m->cpu.memory = m->memory;
+	m->cpu.memory_read_callback = check_read;
+	m->cpu.memory_write_callback = check_write;
+	m->input = input;
+	memcpy(&m->memory[0xFF00], wozmon, wozmon_len);
+	m->memory[0xFFFC] = 0x00;
+	m->memory[0xFFFD] = 0xFF;
+	nsg6502_reset(&m->cpu);
+}
+
+static struct check_machine interpreted;
+static struct check_machine recompiled;
+
+int main(int argc, char **argv) {
+	const char *input =
+		argc > 1 ? argv[1] : "FF00.FFFF\nFFAE: 3D\n0.F\n300: 1 2 3\n300.30F\n";
+
+	check_boot(&interpreted, input);
+	while (!interpreted.done) {
+		nsg6502_opcode_execute(&interpreted.cpu);
+	}
+	check_boot(&recompiled, input);
+	while (!recompiled.done) {
+		nsg6502_recomp_run(&recompiled.cpu, 1024);
+	}
+
+	size_t count = interpreted.count < recompiled.count ? interpreted.count
+														: recompiled.count;
+	for (size_t i = 0; i < count; i++) {
+		if (interpreted.output[i] != recompiled.output[i] ||
+			interpreted.ticks[i] != recompiled.ticks[i]) {
+			fprintf(stderr,
+					"write %zu: interpreter %02X at tick %zu, recompiled %02X "
+					"at tick %zu\n",
+					i, interpreted.output[i], interpreted.ticks[i],
+					recompiled.output[i], recompiled.ticks[i]);
+			return 1;
+		}
+	}
+	if (interpreted.count != recompiled.count) {
+		fprintf(stderr, "interpreter wrote %zu bytes, recompiled %zu\n",
+				interpreted.count, recompiled.count);
+		return 1;
+	}
+	printf("writes=%zu ticks=%zu match\n", count,
+		   count ? interpreted.ticks[count - 1] : 0);
+	return 0;
+}
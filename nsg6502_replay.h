@@ -0,0 +1,158 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Record and replay of device reads.
+//
+// The host records every read whose value does not follow from the machine
+// state (keyboard, random bytes) along with the tick it happened on. Played
+// back, the log answers those reads instead of the devices, so a session
+// runs again without a terminal at full speed. Every replayed read is
+// checked against the log's tick and address: any other read sequence means
+// the emulator changed behaviour and is reported as a divergence.
+//
+// An event is a varint of (tick delta << 1 | new address), the address in
+// two little endian bytes if the flag is set, then the value. A keystroke
+// read soon after the previous one takes two bytes, plus one for every
+// further 7 bits of tick delta, e.g. after a long listing, and two when
+// the address differs from the previous read's, as for a random byte
+// between keystrokes.
+
+#ifndef NSG6502_REPLAY_H
+#define NSG6502_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSG6502_REPLAY_MAGIC "NSG6502R"
+
+#define NSG6502_REPLAY_OK 0
+#define NSG6502_REPLAY_END 1
+#define NSG6502_REPLAY_DIVERGED 2
+#define NSG6502_REPLAY_CORRUPT 3
+
+struct nsg6502_replay {
+	// Recording
+	FILE *out;
+
+	// Replaying, the whole log is read in up front
+	uint8_t *log;
+	size_t size;
+	size_t pos;
+
+	// Tick and address of the previous event
+	uint64_t ticks;
+	uint16_t addr;
+};
+
+static int nsg6502_replay_record_start(struct nsg6502_replay *r, FILE *out) {
+	*r = (struct nsg6502_replay){0};
+	r->out = out;
+	return fwrite(NSG6502_REPLAY_MAGIC, 8, 1, out) == 1 ? 0 : -1;
+}
+
+static void nsg6502_replay_record(struct nsg6502_replay *r, uint64_t ticks,
+								  uint16_t addr, uint8_t value) {
+	int new_addr = addr != r->addr;
+	uint64_t v = ((ticks - r->ticks) << 1) | new_addr;
+	while (v >= 0x80) {
+		fputc((v & 0x7F) | 0x80, r->out);
+		v >>= 7;
+	}
+	fputc(v, r->out);
+	if (new_addr) {
+		fputc(addr & 0xFF, r->out);
+		fputc(addr >> 8, r->out);
+	}
+	fputc(value, r->out);
+	r->ticks = ticks;
+	r->addr = addr;
+}
+
+static int nsg6502_replay_load(struct nsg6502_replay *r, FILE *in) {
+	*r = (struct nsg6502_replay){0};
+	size_t capacity = 0;
+	for (;;) {
+		if (r->size == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			uint8_t *log = realloc(r->log, capacity);
+			if (!log) {
+				free(r->log);
+				return -1;
+			}
+			r->log = log;
+		}
+		size_t n = fread(r->log + r->size, 1, capacity - r->size, in);
+		if (!n) {
+			break;
+		}
+		r->size += n;
+	}
+	if (r->size < 8 || memcmp(r->log, NSG6502_REPLAY_MAGIC, 8) != 0) {
+		free(r->log);
+		r->log = NULL;
+		return -1;
+	}
+	r->pos = 8;
+	return 0;
+}
+
+static void nsg6502_replay_free(struct nsg6502_replay *r) {
+	free(r->log);
+	r->log = NULL;
+}
+
+// Answers the read of addr at ticks from the log
+static int nsg6502_replay_next(struct nsg6502_replay *r, uint64_t ticks,
+							   uint16_t addr, uint8_t *value) {
+	size_t pos = r->pos;
+	uint64_t v = 0;
+	for (int shift = 0;; shift += 7) {
+		if (shift > 63) {
+			return NSG6502_REPLAY_CORRUPT;
+		}
+		if (pos >= r->size) {
+			return NSG6502_REPLAY_END;
+		}
+		uint8_t b = r->log[pos++];
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			break;
+		}
+	}
+	uint16_t event_addr = r->addr;
+	if (v & 1) {
+		if (pos + 2 > r->size) {
+			return NSG6502_REPLAY_END;
+		}
+		event_addr = r->log[pos] | (r->log[pos + 1] << 8);
+		pos += 2;
+	}
+	if (pos >= r->size) {
+		return NSG6502_REPLAY_END;
+	}
+	if (r->ticks + (v >> 1) != ticks || event_addr != addr) {
+		return NSG6502_REPLAY_DIVERGED;
+	}
+	*value = r->log[pos++];
+	r->pos = pos;
+	r->ticks = ticks;
+	r->addr = addr;
+	return NSG6502_REPLAY_OK;
+}
+
+#endif
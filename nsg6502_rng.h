@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Random byte device, one per instance.
+//
+// xoshiro256** seeded through splitmix64. Every 64 bit output is handed out
+// a byte at a time, so the guest reading $FE costs a shift most of the time.
+// All state lives in the struct: two instances seeded alike produce the same
+// bytes, and copying the struct is a complete snapshot of the device.
+
+#ifndef NSG6502_RNG_H
+#define NSG6502_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct nsg6502_rng {
+	uint64_t s[4];
+
+	// Bytes of the last output not handed out yet
+	uint64_t pool;
+	uint8_t pool_left;
+};
+
+static uint64_t nsg6502_rng_rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+static void nsg6502_rng_seed(struct nsg6502_rng *r, uint64_t seed) {
+	for (int i = 0; i < 4; i++) {
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		r->s[i] = z ^ (z >> 31);
+	}
+	r->pool = 0;
+	r->pool_left = 0;
+}
+
+static uint64_t nsg6502_rng_next(struct nsg6502_rng *r) {
+	uint64_t *s = r->s;
+	uint64_t result = nsg6502_rng_rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = nsg6502_rng_rotl(s[3], 45);
+	return result;
+}
+
+static uint8_t nsg6502_rng_byte(struct nsg6502_rng *r) {
+	if (!r->pool_left) {
+		r->pool = nsg6502_rng_next(r);
+		r->pool_left = 8;
+	}
+	uint8_t b = r->pool & 0xFF;
+	r->pool >>= 8;
+	r->pool_left--;
+	return b;
+}
+
+// Same bytes as size calls to nsg6502_rng_byte, eight at a time
+static void nsg6502_rng_fill(struct nsg6502_rng *r, uint8_t *data,
+							 size_t size) {
+	size_t i = 0;
+	while (i < size && r->pool_left) {
+		data[i++] = nsg6502_rng_byte(r);
+	}
+	for (; i + 8 <= size; i += 8) {
+		uint64_t v = nsg6502_rng_next(r);
+		for (int j = 0; j < 8; j++) {
+			data[i + j] = (v >> (j * 8)) & 0xFF;
+		}
+	}
+	while (i < size) {
+		data[i++] = nsg6502_rng_byte(r);
+	}
+}
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs many CPUs on a pool of threads.
+//
+// Every worker owns a deque of instances. It takes work from the front of
+// its own deque and, after running a slice of at most `slice` ticks, puts
+// the instance back at the end, so an instance keeps coming back to the
+// core whose caches hold it while its neighbours still get their turn. A
+// worker that runs dry steals from the front of another worker's deque:
+// the instance there has waited longest since its last slice and is the
+// least likely to still be in the victim's caches, while the ones it has
+// just run stay with it. An instance is finished when its `done` hook says
+// so or its tick budget is used up.
+
+#ifndef NSG6502_SCHED_H
+#define NSG6502_SCHED_H
+
+#include "nsg6502.h"
+#include "nsg6502_observe.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct nsg6502_sched_instance {
+	struct nsg6502_cpu *cpu;
+	// Total ticks to run, 0 for no limit
+	size_t budget;
+	// Optional, stops the instance early when it returns non-zero
+	int (*done)(struct nsg6502_sched_instance *);
+	void *data;
+	// Optional, published at the end of every slice for other threads
+	struct nsg6502_observer *observer;
+
+	size_t start_ticks;
+};
+
+struct nsg6502_sched_worker {
+	pthread_mutex_t lock;
+	struct nsg6502_sched_instance **deque;
+	size_t head;
+	size_t count;
+	size_t capacity;
+
+	pthread_t thread;
+	struct nsg6502_sched *sched;
+};
+
+struct nsg6502_sched {
+	struct nsg6502_sched_worker *workers;
+	size_t worker_count;
+	size_t slice;
+
+	atomic_size_t remaining;
+
+	// Aggregate counters, readable while the pool runs
+	atomic_size_t ticks;
+	atomic_size_t instructions;
+	atomic_size_t slices;
+	atomic_size_t steals;
+	atomic_size_t finished;
+};
+
+static void nsg6502_sched_destroy(struct nsg6502_sched *s) {
+	for (size_t i = 0; i < s->worker_count; i++) {
+		pthread_mutex_destroy(&s->workers[i].lock);
+		free(s->workers[i].deque);
+	}
+	free(s->workers);
+	s->workers = NULL;
+}
+
+// capacity is the most instances the pool will ever hold, any single deque
+// may end up with all of them
+static int nsg6502_sched_init(struct nsg6502_sched *s, size_t workers,
+							  size_t slice, size_t capacity) {
+	s->workers = calloc(workers, sizeof(*s->workers));
+	if (!s->workers) {
+		return -1;
+	}
+	s->worker_count = workers;
+	s->slice = slice;
+	atomic_init(&s->remaining, 0);
+	atomic_init(&s->ticks, 0);
+	atomic_init(&s->instructions, 0);
+	atomic_init(&s->slices, 0);
+	atomic_init(&s->steals, 0);
+	atomic_init(&s->finished, 0);
+
+	for (size_t i = 0; i < workers; i++) {
+		struct nsg6502_sched_worker *w = &s->workers[i];
+		w->deque = calloc(capacity, sizeof(*w->deque));
+		if (!w->deque) {
+			s->worker_count = i;
+			nsg6502_sched_destroy(s);
+			return -1;
+		}
+		pthread_mutex_init(&w->lock, NULL);
+		w->capacity = capacity;
+		w->sched = s;
+	}
+	return 0;
+}
+
+static void nsg6502_sched_push(struct nsg6502_sched_worker *w,
+							   struct nsg6502_sched_instance *inst) {
+	pthread_mutex_lock(&w->lock);
+	w->deque[(w->head + w->count) % w->capacity] = inst;
+	w->count++;
+	pthread_mutex_unlock(&w->lock);
+}
+
+static struct nsg6502_sched_instance *
+nsg6502_sched_pop_front(struct nsg6502_sched_worker *w) {
+	struct nsg6502_sched_instance *inst = NULL;
+	pthread_mutex_lock(&w->lock);
+	if (w->count) {
+		inst = w->deque[w->head];
+		w->head = (w->head + 1) % w->capacity;
+		w->count--;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return inst;
+}
+
+// Hands out instances round robin. Has to be called before
+// nsg6502_sched_run.
+static void nsg6502_sched_add(struct nsg6502_sched *s,
+							  struct nsg6502_sched_instance *inst) {
+	size_t n = atomic_fetch_add(&s->remaining, 1);
+	inst->start_ticks = inst->cpu->ticks;
+	nsg6502_sched_push(&s->workers[n % s->worker_count], inst);
+}
+
+// Runs one slice. Returns non-zero once the instance is finished.
+static int nsg6502_sched_slice(struct nsg6502_sched *s,
+							   struct nsg6502_sched_instance *inst) {
+	struct nsg6502_cpu *c = inst->cpu;
+	size_t start = c->ticks;
+	size_t limit = start + s->slice;
+	if (inst->budget && inst->start_ticks + inst->budget < limit) {
+		limit = inst->start_ticks + inst->budget;
+	}
+
+	size_t instructions = 0;
+	while (c->ticks < limit) {
+#ifdef NSG6502_65C02
+		// Workers are shared, so a CPU in WAI or STP gives up the rest of
+		// its slice instead of blocking in its wait_callback. STP ignores
+		// the interrupt lines.
+		if (c->halt == NSG6502_HALT_STP ||
+			(c->halt && !(c->nmi | c->irq))) {
+			c->ticks = limit;
+			break;
+		}
+#endif
+		nsg6502_opcode_execute(c);
+		instructions++;
+	}
+	if (inst->observer) {
+		nsg6502_observe_publish(inst->observer, c);
+	}
+
+	atomic_fetch_add_explicit(&s->ticks, c->ticks - start,
+							  memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->instructions, instructions,
+							  memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->slices, 1, memory_order_relaxed);
+
+	return (inst->budget && c->ticks - inst->start_ticks >= inst->budget) ||
+		   (inst->done && inst->done(inst));
+}
+
+static void *nsg6502_sched_worker_main(void *arg) {
+	struct nsg6502_sched_worker *w = arg;
+	struct nsg6502_sched *s = w->sched;
+	size_t self = w - s->workers;
+
+	while (atomic_load(&s->remaining)) {
+		struct nsg6502_sched_instance *inst = nsg6502_sched_pop_front(w);
+		for (size_t i = 1; !inst && i < s->worker_count; i++) {
+			inst = nsg6502_sched_pop_front(
+				&s->workers[(self + i) % s->worker_count]);
+			if (inst) {
+				atomic_fetch_add_explicit(&s->steals, 1, memory_order_relaxed);
+			}
+		}
+		if (!inst) {
+			sched_yield();
+			continue;
+		}
+
+		if (nsg6502_sched_slice(s, inst)) {
+			atomic_fetch_add(&s->finished, 1);
+			atomic_fetch_sub(&s->remaining, 1);
+		} else {
+			nsg6502_sched_push(w, inst);
+		}
+	}
+	return NULL;
+}
+
+// Runs until every instance has finished. The calling thread is worker 0.
+// If creating a thread fails the run goes on with fewer; the deques of
+// workers without one are emptied by stealing.
+static void nsg6502_sched_run(struct nsg6502_sched *s) {
+	size_t started = 1;
+	while (started < s->worker_count &&
+		   pthread_create(&s->workers[started].thread, NULL,
+						  nsg6502_sched_worker_main,
+						  &s->workers[started]) == 0) {
+		started++;
+	}
+	nsg6502_sched_worker_main(&s->workers[0]);
+	for (size_t i = 1; i < started; i++) {
+		pthread_join(s->workers[i].thread, NULL);
+	}
+}
+
+#endif
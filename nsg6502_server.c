@@ -0,0 +1,244 @@
+#include "nsg6502_session.h"
+#include "wozmon.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// usage: nsg6502_server <socket path>
+//
+// Serves a wozmon per connection on a Unix socket, all from one thread.
+// Sessions waiting for input are only looked at again once their socket
+// becomes readable, e.g. socat - UNIX-CONNECT:<socket path>
+
+#define SERVER_SLICE 10000
+// Every write to the terminal takes at least two ticks and prints at most
+// two bytes, so a slice never prints more than SERVER_SLICE bytes
+#define SERVER_OUTPUT_SIZE (2 * SERVER_SLICE)
+
+struct server_client {
+	struct nsg6502_session session;
+	int fd;
+
+	uint8_t output[SERVER_OUTPUT_SIZE];
+	size_t output_count;
+
+	// Runnable clients form a circular list walked by the main loop
+	struct server_client *next;
+	struct server_client *prev;
+	int runnable;
+};
+
+static int server_epoll;
+static struct server_client *server_runnable;
+static size_t server_runnable_count;
+// Every connection gets the next seed, runs repeat from one server start
+// to the next
+static uint64_t server_seed = 1;
+
+static void server_runnable_add(struct server_client *cl) {
+	if (cl->runnable) {
+		return;
+	}
+	cl->runnable = 1;
+	server_runnable_count++;
+	if (!server_runnable) {
+		cl->next = cl->prev = cl;
+		server_runnable = cl;
+		return;
+	}
+	cl->next = server_runnable;
+	cl->prev = server_runnable->prev;
+	cl->prev->next = cl;
+	server_runnable->prev = cl;
+}
+
+static void server_runnable_remove(struct server_client *cl) {
+	if (!cl->runnable) {
+		return;
+	}
+	cl->runnable = 0;
+	server_runnable_count--;
+	if (cl->next == cl) {
+		server_runnable = NULL;
+		return;
+	}
+	cl->prev->next = cl->next;
+	cl->next->prev = cl->prev;
+	if (server_runnable == cl) {
+		server_runnable = cl->next;
+	}
+}
+
+static void server_watch(struct server_client *cl) {
+	struct epoll_event ev = {0};
+	ev.data.ptr = cl;
+	// Stop reading while the input buffer is full and the guest is behind,
+	// wait for the socket to drain while output is backed up
+	if (cl->session.input_count < NSG6502_SESSION_INPUT_SIZE) {
+		ev.events |= EPOLLIN;
+	}
+	if (cl->output_count) {
+		ev.events |= EPOLLOUT;
+	}
+	epoll_ctl(server_epoll, EPOLL_CTL_MOD, cl->fd, &ev);
+}
+
+static void server_close(struct server_client *cl) {
+	server_runnable_remove(cl);
+	epoll_ctl(server_epoll, EPOLL_CTL_DEL, cl->fd, NULL);
+	close(cl->fd);
+	free(cl->session.cpu.memory);
+	free(cl);
+}
+
+static void server_output(struct nsg6502_session *s, uint8_t data) {
+	struct server_client *cl = s->data;
+	// server_can_run keeps a slice worth of room free
+	cl->output[cl->output_count++] = data;
+	if (data == '\r') {
+		cl->output[cl->output_count++] = '\n';
+	}
+}
+
+// Returns -1 once the client is gone
+static int server_flush(struct server_client *cl) {
+	if (!cl->output_count) {
+		return 0;
+	}
+	ssize_t n = write(cl->fd, cl->output, cl->output_count);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+	}
+	memmove(cl->output, cl->output + n, cl->output_count - n);
+	cl->output_count -= n;
+	return 0;
+}
+
+// Whether the guest can be run, it stops for input and when there is no
+// room left for what a slice might print
+static int server_can_run(struct server_client *cl) {
+	return !cl->session.waiting &&
+		   cl->output_count <= SERVER_OUTPUT_SIZE - SERVER_SLICE;
+}
+
+static void server_accept(int listener) {
+	for (;;) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			return;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		struct server_client *cl = calloc(1, sizeof(*cl));
+		uint8_t *memory = calloc(1, 0xFFFF + 1);
+		if (!cl || !memory) {
+			free(cl);
+			free(memory);
+			close(fd);
+			continue;
+		}
+		memcpy(&memory[0xFF00], wozmon, wozmon_len);
+		memory[0xFFFC] = 0x00;
+		memory[0xFFFD] = 0xFF;
+		nsg6502_session_init(&cl->session, memory, server_seed++);
+		cl->session.output = server_output;
+		cl->session.data = cl;
+		cl->fd = fd;
+
+		struct epoll_event ev = {EPOLLIN, {.ptr = cl}};
+		epoll_ctl(server_epoll, EPOLL_CTL_ADD, fd, &ev);
+		server_runnable_add(cl);
+	}
+}
+
+static void server_event(struct server_client *cl, uint32_t events) {
+	if (events & EPOLLIN) {
+		uint8_t buffer[NSG6502_SESSION_INPUT_SIZE];
+		size_t room = NSG6502_SESSION_INPUT_SIZE - cl->session.input_count;
+		ssize_t n = read(cl->fd, buffer, room);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			server_close(cl);
+			return;
+		}
+		if (n > 0) {
+			nsg6502_session_input(&cl->session, buffer, n);
+		}
+	} else if (events & (EPOLLHUP | EPOLLERR)) {
+		server_close(cl);
+		return;
+	}
+	if ((events & EPOLLOUT) && server_flush(cl) != 0) {
+		server_close(cl);
+		return;
+	}
+	if (server_can_run(cl)) {
+		server_runnable_add(cl);
+	}
+	server_watch(cl);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: path too long\n", argv[1]);
+		return 1;
+	}
+	strcpy(addr.sun_path, argv[1]);
+	unlink(argv[1]);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 ||
+		bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+		listen(listener, SOMAXCONN) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+	server_epoll = epoll_create1(0);
+	struct epoll_event ev = {EPOLLIN, {.ptr = NULL}};
+	epoll_ctl(server_epoll, EPOLL_CTL_ADD, listener, &ev);
+
+	struct epoll_event events[256];
+	for (;;) {
+		// Only block when every guest is waiting on its client
+		int n = epoll_wait(server_epoll, events, 256, server_runnable ? 0 : -1);
+		for (int i = 0; i < n; i++) {
+			if (!events[i].data.ptr) {
+				server_accept(listener);
+			} else {
+				server_event(events[i].data.ptr, events[i].events);
+			}
+		}
+
+		// One slice for every runnable guest per round
+		struct server_client *cl = server_runnable;
+		for (size_t left = server_runnable_count; cl && left; left--) {
+			struct server_client *next = cl->next;
+			nsg6502_session_run(&cl->session, SERVER_SLICE);
+			if (server_flush(cl) != 0) {
+				server_close(cl);
+			} else {
+				if (!server_can_run(cl)) {
+					server_runnable_remove(cl);
+				}
+				server_watch(cl);
+			}
+			cl = server_runnable ? next : NULL;
+		}
+	}
+}
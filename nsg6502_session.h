@@ -0,0 +1,149 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A CPU wired to a terminal that never blocks the host.
+//
+// The terminal has the same registers main.c gives wozmon: output at
+// NSG6502_SESSION_OUTPUT, input data at NSG6502_SESSION_INPUT and input
+// status at NSG6502_SESSION_STATUS. Input is fed in by the host with
+// nsg6502_session_input(). When the guest reads either input register while
+// nothing is buffered, the instruction doing the read is rolled back and
+// nsg6502_session_run() returns NSG6502_SESSION_WAITING. The CPU is then
+// parked on that instruction and simply retries it on the next run, so a
+// session costs nothing but its memory while it waits.
+
+#ifndef NSG6502_SESSION_H
+#define NSG6502_SESSION_H
+
+#include "nsg6502.h"
+#include "nsg6502_rng.h"
+
+#ifndef NSG6502_SESSION_OUTPUT
+#define NSG6502_SESSION_OUTPUT 0x0200
+#endif
+#ifndef NSG6502_SESSION_INPUT
+#define NSG6502_SESSION_INPUT 0x0201
+#endif
+#ifndef NSG6502_SESSION_STATUS
+#define NSG6502_SESSION_STATUS 0x0202
+#endif
+#ifndef NSG6502_SESSION_RANDOM
+#define NSG6502_SESSION_RANDOM 0x00FE
+#endif
+
+#define NSG6502_SESSION_INPUT_SIZE 256
+
+#define NSG6502_SESSION_RUNNING 0
+#define NSG6502_SESSION_WAITING 1
+
+struct nsg6502_session {
+	// Has to stay first, the bus callbacks get the session from the CPU
+	struct nsg6502_cpu cpu;
+
+	uint8_t input[NSG6502_SESSION_INPUT_SIZE];
+	size_t input_head;
+	size_t input_count;
+	int waiting;
+
+	struct nsg6502_rng rng;
+
+	// Called for every byte the guest writes to the output register
+	void (*output)(struct nsg6502_session *, uint8_t);
+	void *data;
+};
+
+static uint8_t nsg6502_session_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_session *s = (struct nsg6502_session *)c;
+	if (addr == NSG6502_SESSION_RANDOM) {
+		return nsg6502_rng_byte(&s->rng);
+	} else if (addr == NSG6502_SESSION_STATUS ||
+			   addr == NSG6502_SESSION_INPUT) {
+		if (!s->input_count) {
+			s->waiting = 1;
+			return 0;
+		}
+		if (addr == NSG6502_SESSION_STATUS) {
+			return 1;
+		}
+		uint8_t k = s->input[s->input_head];
+		s->input_head = (s->input_head + 1) % NSG6502_SESSION_INPUT_SIZE;
+		s->input_count--;
+		return k;
+	}
+	return c->memory[addr];
+}
+
+static void nsg6502_session_write(struct nsg6502_cpu *c, uint16_t addr,
+								  uint8_t data) {
+	struct nsg6502_session *s = (struct nsg6502_session *)c;
+	if (s->waiting) {
+		// Read-modify-write of an input register, the whole instruction is
+		// going to be rolled back
+		return;
+	}
+	if (addr == NSG6502_SESSION_OUTPUT && s->output) {
+		s->output(s, data);
+	}
+	c->memory[addr] = data;
+}
+
+// memory has to be 64 KiB and already hold the program and its vectors
+static void nsg6502_session_init(struct nsg6502_session *s, uint8_t *memory,
+								 uint64_t seed) {
+	*s = (struct nsg6502_session){0};
+	nsg6502_rng_seed(&s->rng, seed);
+	s->cpu.memory = memory;
+	s->cpu.memory_read_callback = nsg6502_session_read;
+	s->cpu.memory_write_callback = nsg6502_session_write;
+	nsg6502_reset(&s->cpu);
+}
+
+// Queues up to size bytes of input, '\n' becomes '\r'. Returns how many
+// were taken.
+static size_t nsg6502_session_input(struct nsg6502_session *s,
+									const uint8_t *data, size_t size) {
+	size_t n = 0;
+	while (n < size && s->input_count < NSG6502_SESSION_INPUT_SIZE) {
+		s->input[(s->input_head + s->input_count) %
+				 NSG6502_SESSION_INPUT_SIZE] =
+			data[n] == '\n' ? '\r' : data[n];
+		s->input_count++;
+		n++;
+	}
+	if (n) {
+		s->waiting = 0;
+	}
+	return n;
+}
+
+// Runs for about budget ticks, or until the guest waits for input.
+static int nsg6502_session_run(struct nsg6502_session *s, size_t budget) {
+	if (s->waiting) {
+		return NSG6502_SESSION_WAITING;
+	}
+	size_t limit = s->cpu.ticks + budget;
+	while (s->cpu.ticks < limit) {
+		struct nsg6502_cpu saved = s->cpu;
+		nsg6502_opcode_execute(&s->cpu);
+		if (s->waiting) {
+			s->cpu = saved;
+			return NSG6502_SESSION_WAITING;
+		}
+	}
+	return NSG6502_SESSION_RUNNING;
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Machine snapshots: registers, interrupt lines, all 64 KiB of memory and
+// the random byte device. Lazy flags are folded into status on save, so a
+// snapshot does not depend on the options the core was built with.
+// Callbacks and traps are host wiring and are left alone on restore.
+
+#ifndef NSG6502_SNAPSHOT_H
+#define NSG6502_SNAPSHOT_H
+
+#include "nsg6502.h"
+#include "nsg6502_rng.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NSG6502_SNAPSHOT_MAGIC "NSG6502S"
+#define NSG6502_SNAPSHOT_VERSION 2
+
+struct nsg6502_snapshot {
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t sp;
+	uint8_t status;
+	uint16_t pc;
+	uint64_t ticks;
+
+	// Pending interrupts and the WAI/STP state, which is always 0 when
+	// saved from an NMOS build and ignored when restored into one
+	uint8_t irq;
+	uint8_t nmi;
+	uint8_t halt;
+
+	struct nsg6502_rng rng;
+
+	uint8_t memory[0x10000];
+};
+
+// rng may be NULL for machines without the device. Returns -1, and saves
+// nothing, for a CPU without a memory array.
+static int nsg6502_snapshot_save(struct nsg6502_snapshot *s,
+								 struct nsg6502_cpu *c,
+								 const struct nsg6502_rng *rng) {
+	if (!c->memory) {
+		return -1;
+	}
+	nsg6502_flags_resolve(c);
+	s->a = c->a;
+	s->x = c->x;
+	s->y = c->y;
+	s->sp = c->sp;
+	s->status = c->status;
+	s->pc = c->pc;
+	s->ticks = c->ticks;
+	s->irq = c->irq;
+	s->nmi = c->nmi;
+#ifdef NSG6502_65C02
+	s->halt = c->halt;
+#else
+	s->halt = 0;
+#endif
+	if (rng) {
+		s->rng = *rng;
+	} else {
+		memset(&s->rng, 0, sizeof(s->rng));
+	}
+	memcpy(s->memory, c->memory, sizeof(s->memory));
+	return 0;
+}
+
+// Everything but memory, for hosts that put back only what changed
+static void nsg6502_snapshot_restore_registers(const struct nsg6502_snapshot *s,
+											   struct nsg6502_cpu *c,
+											   struct nsg6502_rng *rng) {
+	c->a = s->a;
+	c->x = s->x;
+	c->y = s->y;
+	c->sp = s->sp;
+	c->status = s->status;
+	c->pc = s->pc;
+	c->ticks = s->ticks;
+	c->irq = s->irq;
+	c->nmi = s->nmi;
+#ifdef NSG6502_65C02
+	c->halt = s->halt;
+#endif
+#ifdef NSG6502_LAZY_FLAGS
+	c->lazy_op = NSG6502_LAZY_NONE;
+#endif
+	if (rng) {
+		*rng = s->rng;
+	}
+}
+
+// Returns -1, and restores nothing, for a CPU without a memory array
+static int nsg6502_snapshot_restore(const struct nsg6502_snapshot *s,
+									struct nsg6502_cpu *c,
+									struct nsg6502_rng *rng) {
+	if (!c->memory) {
+		return -1;
+	}
+	nsg6502_snapshot_restore_registers(s, c, rng);
+	memcpy(c->memory, s->memory, sizeof(s->memory));
+	return 0;
+}
+
+static void nsg6502_snapshot_put(uint8_t *p, uint64_t v, int size) {
+	for (int i = 0; i < size; i++) {
+		p[i] = (v >> (i * 8)) & 0xFF;
+	}
+}
+
+static uint64_t nsg6502_snapshot_get(const uint8_t *p, int size) {
+	uint64_t v = 0;
+	for (int i = 0; i < size; i++) {
+		v |= (uint64_t)p[i] << (i * 8);
+	}
+	return v;
+}
+
+// The file layout is little endian and packed, the same on every host:
+// magic, version, A X Y SP P, PC, ticks, rng state, pool, pool left, IRQ,
+// NMI, halt, memory.
+#define NSG6502_SNAPSHOT_HEADER_SIZE (8 + 1 + 5 + 2 + 8 + 32 + 8 + 1 + 3)
+
+static int nsg6502_snapshot_write(const struct nsg6502_snapshot *s,
+								  FILE *f) {
+	uint8_t h[NSG6502_SNAPSHOT_HEADER_SIZE];
+	uint8_t *p = h;
+	memcpy(p, NSG6502_SNAPSHOT_MAGIC, 8);
+	p += 8;
+	*p++ = NSG6502_SNAPSHOT_VERSION;
+	*p++ = s->a;
+	*p++ = s->x;
+	*p++ = s->y;
+	*p++ = s->sp;
+	*p++ = s->status;
+	nsg6502_snapshot_put(p, s->pc, 2);
+	p += 2;
+	nsg6502_snapshot_put(p, s->ticks, 8);
+	p += 8;
+	for (int i = 0; i < 4; i++, p += 8) {
+		nsg6502_snapshot_put(p, s->rng.s[i], 8);
+	}
+	nsg6502_snapshot_put(p, s->rng.pool, 8);
+	p += 8;
+	*p++ = s->rng.pool_left;
+	*p++ = s->irq;
+	*p++ = s->nmi;
+	*p++ = s->halt;
+
+	if (fwrite(h, sizeof(h), 1, f) != 1 ||
+		fwrite(s->memory, sizeof(s->memory), 1, f) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+static int nsg6502_snapshot_read(struct nsg6502_snapshot *s, FILE *f) {
+	uint8_t h[NSG6502_SNAPSHOT_HEADER_SIZE];
+	const uint8_t *p = h;
+	if (fread(h, sizeof(h), 1, f) != 1 ||
+		memcmp(p, NSG6502_SNAPSHOT_MAGIC, 8) != 0 ||
+		p[8] != NSG6502_SNAPSHOT_VERSION) {
+		return -1;
+	}
+	p += 9;
+	s->a = *p++;
+	s->x = *p++;
+	s->y = *p++;
+	s->sp = *p++;
+	s->status = *p++;
+	s->pc = nsg6502_snapshot_get(p, 2);
+	p += 2;
+	s->ticks = nsg6502_snapshot_get(p, 8);
+	p += 8;
+	for (int i = 0; i < 4; i++, p += 8) {
+		s->rng.s[i] = nsg6502_snapshot_get(p, 8);
+	}
+	s->rng.pool = nsg6502_snapshot_get(p, 8);
+	p += 8;
+	s->rng.pool_left = *p++;
+	s->irq = *p++;
+	s->nmi = *p++;
+	s->halt = *p;
+
+	if (fread(s->memory, sizeof(s->memory), 1, f) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Live run statistics in shared memory.
+//
+// Every instance publishes one page, by default
+// /dev/shm/nsg6502-stats.<pid>, with its instructions, ticks, bus callback
+// counts, time spent idle and bytes moved per device. Only the instance
+// writes it, so counters are bumped with a relaxed load and store, no
+// locked instructions, and readers in other processes see each counter
+// whole but not all of them from the same instant. nsg6502_stats_export
+// serves every page in a directory to Prometheus.
+//
+// All functions do nothing on a struct nsg6502_stats that is not open, so
+// hosts can leave the calls in and only open the page when asked to.
+
+#ifndef NSG6502_STATS_H
+#define NSG6502_STATS_H
+
+#include "nsg6502.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSG6502_STATS_MAGIC 0x5354534E // "NSTS"
+#define NSG6502_STATS_VERSION 1
+#define NSG6502_STATS_PREFIX "nsg6502-stats."
+#define NSG6502_STATS_NAME_SIZE 32
+#define NSG6502_STATS_DEVICES 8
+
+struct nsg6502_stats_device {
+	char name[NSG6502_STATS_NAME_SIZE];
+	// Bytes the guest read from and wrote to the device
+	atomic_uint_fast64_t read;
+	atomic_uint_fast64_t written;
+};
+
+struct nsg6502_stats_page {
+	// Stored last, with release, once the rest of the header is filled in
+	atomic_uint magic;
+	uint32_t version;
+	int32_t pid;
+	// Devices are named before the count is raised past them
+	atomic_uint device_count;
+	char name[NSG6502_STATS_NAME_SIZE];
+	// CLOCK_REALTIME when the page was opened
+	uint64_t start_ns;
+
+	_Alignas(64) atomic_uint_fast64_t instructions;
+	atomic_uint_fast64_t ticks;
+	// Calls into memory_read_callback and memory_write_callback
+	atomic_uint_fast64_t reads;
+	atomic_uint_fast64_t writes;
+	// Wall time the instance spent blocked or parked instead of running
+	atomic_uint_fast64_t idle_ns;
+
+	struct nsg6502_stats_device devices[NSG6502_STATS_DEVICES];
+};
+
+struct nsg6502_stats {
+	struct nsg6502_stats_page *page;
+	char path[256];
+	uint64_t idle_start;
+};
+
+static uint64_t nsg6502_stats_clock(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Only the owner adds, so this needs no read-modify-write instruction
+static void nsg6502_stats_add(atomic_uint_fast64_t *counter, uint64_t n) {
+	atomic_store_explicit(
+		counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+		memory_order_relaxed);
+}
+
+// Creates the page at path, or in /dev/shm when path is NULL. name labels
+// the instance in the exported metrics.
+static int nsg6502_stats_open(struct nsg6502_stats *s, const char *path,
+							  const char *name) {
+	*s = (struct nsg6502_stats){0};
+	if (path) {
+		snprintf(s->path, sizeof(s->path), "%s", path);
+	} else {
+		snprintf(s->path, sizeof(s->path),
+				 "/dev/shm/" NSG6502_STATS_PREFIX "%d", (int)getpid());
+	}
+
+	// A new file, so that a reader still mapping a stale page with the
+	// same name never sees it shrink
+	unlink(s->path);
+	int fd = open(s->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	struct nsg6502_stats_page *page = MAP_FAILED;
+	if (ftruncate(fd, sizeof(*page)) == 0) {
+		page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED,
+					fd, 0);
+	}
+	close(fd);
+	if (page == MAP_FAILED) {
+		unlink(s->path);
+		return -1;
+	}
+
+	page->version = NSG6502_STATS_VERSION;
+	page->pid = getpid();
+	snprintf(page->name, sizeof(page->name), "%s", name ? name : "");
+	page->start_ns = nsg6502_stats_clock(CLOCK_REALTIME);
+	atomic_store_explicit(&page->magic, NSG6502_STATS_MAGIC,
+						  memory_order_release);
+	s->page = page;
+	return 0;
+}
+
+// Removes the page, an instance that is gone should not be scraped
+static void nsg6502_stats_close(struct nsg6502_stats *s) {
+	if (!s->page) {
+		return;
+	}
+	munmap(s->page, sizeof(*s->page));
+	unlink(s->path);
+	s->page = NULL;
+}
+
+// Adds a device to count bytes for. Returns its index, or -1 when the page
+// is full or not open.
+static int nsg6502_stats_device(struct nsg6502_stats *s, const char *name) {
+	if (!s->page) {
+		return -1;
+	}
+	unsigned int n =
+		atomic_load_explicit(&s->page->device_count, memory_order_relaxed);
+	if (n == NSG6502_STATS_DEVICES) {
+		return -1;
+	}
+	snprintf(s->page->devices[n].name, NSG6502_STATS_NAME_SIZE, "%s", name);
+	atomic_store_explicit(&s->page->device_count, n + 1,
+						  memory_order_release);
+	return n;
+}
+
+// Adds instructions run since the last call and takes the CPU's ticks.
+// Meant to be called once per slice of the run loop.
+static void nsg6502_stats_run(struct nsg6502_stats *s, struct nsg6502_cpu *c,
+							  uint64_t instructions) {
+	if (!s->page) {
+		return;
+	}
+	nsg6502_stats_add(&s->page->instructions, instructions);
+	atomic_store_explicit(&s->page->ticks, c->ticks, memory_order_relaxed);
+}
+
+static void nsg6502_stats_read(struct nsg6502_stats *s) {
+	if (s->page) {
+		nsg6502_stats_add(&s->page->reads, 1);
+	}
+}
+
+static void nsg6502_stats_write(struct nsg6502_stats *s) {
+	if (s->page) {
+		nsg6502_stats_add(&s->page->writes, 1);
+	}
+}
+
+static void nsg6502_stats_device_read(struct nsg6502_stats *s, int device,
+									  uint64_t bytes) {
+	if (s->page && device >= 0) {
+		nsg6502_stats_add(&s->page->devices[device].read, bytes);
+	}
+}
+
+static void nsg6502_stats_device_write(struct nsg6502_stats *s, int device,
+									   uint64_t bytes) {
+	if (s->page && device >= 0) {
+		nsg6502_stats_add(&s->page->devices[device].written, bytes);
+	}
+}
+
+// Brackets time the instance spends blocked, e.g. waiting for input
+static void nsg6502_stats_idle_begin(struct nsg6502_stats *s) {
+	if (s->page) {
+		s->idle_start = nsg6502_stats_clock(CLOCK_MONOTONIC);
+	}
+}
+
+static void nsg6502_stats_idle_end(struct nsg6502_stats *s) {
+	if (s->page) {
+		nsg6502_stats_add(&s->page->idle_ns,
+						  nsg6502_stats_clock(CLOCK_MONOTONIC) - s->idle_start);
+	}
+}
+
+// Maps someone else's page read only. Returns NULL if path is not a
+// complete page of this version.
+static const struct nsg6502_stats_page *nsg6502_stats_map(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct nsg6502_stats_page *page = MAP_FAILED;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*page)) {
+		page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (page == MAP_FAILED) {
+		return NULL;
+	}
+	if (atomic_load_explicit(&page->magic, memory_order_acquire) !=
+			NSG6502_STATS_MAGIC ||
+		page->version != NSG6502_STATS_VERSION) {
+		munmap(page, sizeof(*page));
+		return NULL;
+	}
+	return page;
+}
+
+static void nsg6502_stats_unmap(const struct nsg6502_stats_page *page) {
+	munmap((void *)page, sizeof(*page));
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "nsg6502_stats.h"
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// usage: nsg6502_stats_export <socket path> [directory]
+//
+// Serves the statistics pages in directory (/dev/shm by default) as
+// Prometheus text over HTTP on a Unix socket, e.g.
+// curl --unix-socket <socket path> http://localhost/metrics
+// Pages are mapped for the length of one scrape, so the cost is one open
+// and one mmap per instance. Pages left behind by processes that are gone
+// are skipped.
+
+struct export_counter {
+	const char *name;
+	const char *help;
+	size_t offset;
+	// Nanoseconds, exported in seconds
+	int ns;
+};
+
+static const struct export_counter export_counters[] = {
+	{"nsg6502_instructions_total", "Guest instructions retired.",
+	 offsetof(struct nsg6502_stats_page, instructions), 0},
+	{"nsg6502_ticks_total", "Guest clock ticks.",
+	 offsetof(struct nsg6502_stats_page, ticks), 0},
+	{"nsg6502_bus_reads_total", "Calls into the memory read callback.",
+	 offsetof(struct nsg6502_stats_page, reads), 0},
+	{"nsg6502_bus_writes_total", "Calls into the memory write callback.",
+	 offsetof(struct nsg6502_stats_page, writes), 0},
+	{"nsg6502_idle_seconds_total", "Time spent blocked or parked.",
+	 offsetof(struct nsg6502_stats_page, idle_ns), 1},
+};
+
+static const struct nsg6502_stats_page **export_pages;
+static size_t export_page_count;
+static size_t export_page_capacity;
+
+static void export_scan(const char *directory) {
+	export_page_count = 0;
+	DIR *d = opendir(directory);
+	if (!d) {
+		return;
+	}
+	struct dirent *e;
+	while ((e = readdir(d))) {
+		if (strncmp(e->d_name, NSG6502_STATS_PREFIX,
+					strlen(NSG6502_STATS_PREFIX))) {
+			continue;
+		}
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%s", directory, e->d_name);
+		const struct nsg6502_stats_page *page = nsg6502_stats_map(path);
+		if (!page) {
+			continue;
+		}
+		if (kill(page->pid, 0) != 0 && errno == ESRCH) {
+			nsg6502_stats_unmap(page);
+			continue;
+		}
+		if (export_page_count == export_page_capacity) {
+			size_t capacity =
+				export_page_capacity ? export_page_capacity * 2 : 64;
+			const struct nsg6502_stats_page **pages =
+				realloc(export_pages, capacity * sizeof(*pages));
+			if (!pages) {
+				nsg6502_stats_unmap(page);
+				break;
+			}
+			export_pages = pages;
+			export_page_capacity = capacity;
+		}
+		export_pages[export_page_count++] = page;
+	}
+	closedir(d);
+}
+
+// Label values may hold anything the instance was named
+static void export_label(FILE *out, const char *value, size_t size) {
+	for (size_t i = 0; i < size && value[i]; i++) {
+		if (value[i] == '\\' || value[i] == '"') {
+			fprintf(out, "\\%c", value[i]);
+		} else if (value[i] == '\n') {
+			fprintf(out, "\\n");
+		} else {
+			fputc(value[i], out);
+		}
+	}
+}
+
+static void export_labels(FILE *out, const struct nsg6502_stats_page *page) {
+	fprintf(out, "{name=\"");
+	export_label(out, page->name, sizeof(page->name));
+	fprintf(out, "\",pid=\"%d\"", page->pid);
+}
+
+static void export_render(FILE *out) {
+	for (size_t i = 0;
+		 i < sizeof(export_counters) / sizeof(export_counters[0]); i++) {
+		const struct export_counter *m = &export_counters[i];
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", m->name, m->help,
+				m->name);
+		for (size_t p = 0; p < export_page_count; p++) {
+			const struct nsg6502_stats_page *page = export_pages[p];
+			uint64_t v = atomic_load_explicit(
+				(atomic_uint_fast64_t *)((char *)page + m->offset),
+				memory_order_relaxed);
+			fprintf(out, "%s", m->name);
+			export_labels(out, page);
+			if (m->ns) {
+				fprintf(out, "} %.9f\n", v / 1e9);
+			} else {
+				fprintf(out, "} %llu\n", (unsigned long long)v);
+			}
+		}
+	}
+
+	fprintf(out, "# HELP nsg6502_start_time_seconds When the instance "
+				 "started, since the epoch.\n"
+				 "# TYPE nsg6502_start_time_seconds gauge\n");
+	for (size_t p = 0; p < export_page_count; p++) {
+		fprintf(out, "nsg6502_start_time_seconds");
+		export_labels(out, export_pages[p]);
+		fprintf(out, "} %.3f\n", export_pages[p]->start_ns / 1e9);
+	}
+
+	for (int written = 0; written < 2; written++) {
+		const char *name = written ? "nsg6502_device_written_bytes_total"
+								   : "nsg6502_device_read_bytes_total";
+		fprintf(out, "# HELP %s Bytes the guest %s a device.\n", name,
+				written ? "wrote to" : "read from");
+		fprintf(out, "# TYPE %s counter\n", name);
+		for (size_t p = 0; p < export_page_count; p++) {
+			const struct nsg6502_stats_page *page = export_pages[p];
+			unsigned int count = atomic_load_explicit(
+				(atomic_uint *)&page->device_count, memory_order_acquire);
+			for (unsigned int i = 0; i < count && i < NSG6502_STATS_DEVICES;
+				 i++) {
+				const struct nsg6502_stats_device *d = &page->devices[i];
+				uint64_t v = atomic_load_explicit(
+					(atomic_uint_fast64_t *)(written ? &d->written : &d->read),
+					memory_order_relaxed);
+				fprintf(out, "%s", name);
+				export_labels(out, page);
+				fprintf(out, ",device=\"");
+				export_label(out, d->name, sizeof(d->name));
+				fprintf(out, "\"} %llu\n", (unsigned long long)v);
+			}
+		}
+	}
+}
+
+static void export_serve(int fd, const char *directory) {
+	// Whatever was asked for, the answer is the same, but the request has
+	// to be read or some clients see a reset
+	struct timeval timeout = {1, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	char request[4096];
+	size_t got = 0;
+	while (got < sizeof(request) - 1) {
+		ssize_t n = read(fd, request + got, sizeof(request) - 1 - got);
+		if (n <= 0) {
+			break;
+		}
+		got += n;
+		request[got] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+			break;
+		}
+	}
+
+	char *body = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&body, &size);
+	if (!out) {
+		return;
+	}
+	export_scan(directory);
+	export_render(out);
+	for (size_t i = 0; i < export_page_count; i++) {
+		nsg6502_stats_unmap(export_pages[i]);
+	}
+	fclose(out);
+
+	char header[256];
+	int length = snprintf(header, sizeof(header),
+						  "HTTP/1.0 200 OK\r\n"
+						  "Content-Type: text/plain; version=0.0.4\r\n"
+						  "Content-Length: %zu\r\n\r\n",
+						  size);
+	if (write(fd, header, length) == length) {
+		for (size_t done = 0; done < size;) {
+			ssize_t n = write(fd, body + done, size - done);
+			if (n <= 0) {
+				break;
+			}
+			done += n;
+		}
+	}
+	free(body);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <socket path> [directory]\n", argv[0]);
+		return 1;
+	}
+	const char *directory = argc > 2 ? argv[2] : "/dev/shm";
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: path too long\n", argv[1]);
+		return 1;
+	}
+	strcpy(addr.sun_path, argv[1]);
+	unlink(argv[1]);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 ||
+		bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+		listen(listener, SOMAXCONN) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	for (;;) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+		export_serve(fd, directory);
+		close(fd);
+	}
+}
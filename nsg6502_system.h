@@ -0,0 +1,307 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Several CPUs sharing memory.
+//
+// Every CPU has its own 64 KiB in c->memory, and the pages given to
+// nsg6502_system_share() are replaced by one block of memory all of them
+// see. The CPUs run in quanta: each runs on its own up to the end of the
+// quantum, then they all wait for each other. Within a quantum a CPU reads
+// shared memory as it was at the start, plus its own writes; the writes
+// are logged and applied at the end of the quantum, CPU by CPU in index
+// order. What any CPU sees therefore only depends on the quanta, never on
+// which thread ran it or when, and nsg6502_system_run() gives the same
+// result on any number of threads.
+//
+// The other CPUs see a write one quantum later at most. Quanta are
+// shared_quantum ticks long until quantum ticks have passed without any
+// CPU touching shared memory, and quantum ticks from then on, so polling a
+// mailbox is answered quickly and independent code runs with few stops. A
+// CPU whose write log fills up ends its quantum early and catches up in
+// the next.
+//
+// A mailbox is a shared byte that raises bits in one CPU's irq when
+// written, and drops them when that CPU reads it.
+
+#ifndef NSG6502_SYSTEM_H
+#define NSG6502_SYSTEM_H
+
+#include "nsg6502.h"
+#include <pthread.h>
+#include <string.h>
+
+#define NSG6502_SYSTEM_MAX_WRITES 1024
+#define NSG6502_SYSTEM_MAX_MAILBOXES 16
+#define NSG6502_SYSTEM_MAX_THREADS 64
+
+struct nsg6502_system;
+
+struct nsg6502_system_write {
+	uint16_t addr;
+	uint8_t data;
+};
+
+struct nsg6502_system_cpu {
+	// Has to stay first, the bus callbacks get the rest from the CPU
+	struct nsg6502_cpu cpu;
+	struct nsg6502_system *system;
+	size_t index;
+
+	// Called for private addresses, if set, instead of using c->memory
+	uint8_t (*read)(struct nsg6502_cpu *, uint16_t);
+	void (*write)(struct nsg6502_cpu *, uint16_t, uint8_t);
+
+	struct nsg6502_system_write log[NSG6502_SYSTEM_MAX_WRITES];
+	size_t log_count;
+	int shared_access;
+};
+
+struct nsg6502_system_mailbox {
+	uint16_t addr;
+	size_t cpu;
+	uint8_t irq;
+};
+
+struct nsg6502_system {
+	struct nsg6502_system_cpu *cpus;
+	size_t count;
+
+	uint8_t shared[0x10000];
+	uint8_t shared_page[0x100];
+	struct nsg6502_system_mailbox mailboxes[NSG6502_SYSTEM_MAX_MAILBOXES];
+	size_t mailbox_count;
+
+	size_t quantum;
+	size_t shared_quantum;
+	// Where every CPU is at the end of the current quantum
+	size_t time;
+
+	// End of the last quantum in which shared memory was used
+	size_t shared_time;
+
+	size_t threads;
+	size_t end;
+	int done;
+	pthread_barrier_t barrier;
+	// Held while the threads are started, until their number is final
+	pthread_mutex_t start;
+};
+
+static uint8_t nsg6502_system_read(struct nsg6502_cpu *c, uint16_t addr) {
+	struct nsg6502_system_cpu *sc = (struct nsg6502_system_cpu *)c;
+	struct nsg6502_system *s = sc->system;
+	if (!s->shared_page[addr >> 8]) {
+		return sc->read ? sc->read(c, addr) : c->memory[addr];
+	}
+	sc->shared_access = 1;
+	for (size_t i = 0; i < s->mailbox_count; i++) {
+		if (s->mailboxes[i].addr == addr && s->mailboxes[i].cpu == sc->index) {
+			c->irq &= ~s->mailboxes[i].irq;
+		}
+	}
+	for (size_t i = sc->log_count; i-- > 0;) {
+		if (sc->log[i].addr == addr) {
+			return sc->log[i].data;
+		}
+	}
+	return s->shared[addr];
+}
+
+static void nsg6502_system_write(struct nsg6502_cpu *c, uint16_t addr,
+								 uint8_t data) {
+	struct nsg6502_system_cpu *sc = (struct nsg6502_system_cpu *)c;
+	struct nsg6502_system *s = sc->system;
+	if (!s->shared_page[addr >> 8]) {
+		if (sc->write) {
+			sc->write(c, addr, data);
+		} else {
+			c->memory[addr] = data;
+		}
+		return;
+	}
+	sc->shared_access = 1;
+	// The run loop stops the CPU before this can overflow, as an
+	// instruction writes three bytes at most
+	sc->log[sc->log_count++] = (struct nsg6502_system_write){addr, data};
+}
+
+// Runs one CPU up to the end of the quantum
+static void nsg6502_system_run_cpu(struct nsg6502_system_cpu *sc,
+								   size_t time) {
+	struct nsg6502_cpu *c = &sc->cpu;
+	while (c->ticks < time &&
+		   sc->log_count <= NSG6502_SYSTEM_MAX_WRITES - 3) {
+#ifdef NSG6502_65C02
+		// Mailbox interrupts only arrive between quanta, so a CPU in WAI
+		// can skip the rest of this one. One in STP only leaves it on reset,
+		// whatever lines are raised.
+		if (c->halt == NSG6502_HALT_STP ||
+			(c->halt && !(c->nmi | c->irq))) {
+			c->ticks = time;
+			break;
+		}
+#endif
+		nsg6502_opcode_execute(c);
+	}
+}
+
+// Starts the next quantum
+static void nsg6502_system_next(struct nsg6502_system *s) {
+	size_t quantum = s->time - s->shared_time < s->quantum ? s->shared_quantum
+														   : s->quantum;
+	s->time = s->end - s->time < quantum ? s->end : s->time + quantum;
+}
+
+// Applies the write logs and picks the next quantum. Runs on one thread
+// while the others wait.
+static void nsg6502_system_commit(struct nsg6502_system *s) {
+	int shared_access = 0;
+	for (size_t i = 0; i < s->count; i++) {
+		struct nsg6502_system_cpu *sc = &s->cpus[i];
+		for (size_t j = 0; j < sc->log_count; j++) {
+			struct nsg6502_system_write *w = &sc->log[j];
+			s->shared[w->addr] = w->data;
+			for (size_t k = 0; k < s->mailbox_count; k++) {
+				if (s->mailboxes[k].addr == w->addr) {
+					s->cpus[s->mailboxes[k].cpu].cpu.irq |= s->mailboxes[k].irq;
+				}
+			}
+		}
+		sc->log_count = 0;
+		shared_access |= sc->shared_access;
+		sc->shared_access = 0;
+	}
+	if (shared_access) {
+		s->shared_time = s->time;
+	}
+	if (s->time >= s->end) {
+		s->done = 1;
+		return;
+	}
+	nsg6502_system_next(s);
+}
+
+struct nsg6502_system_thread {
+	struct nsg6502_system *system;
+	size_t index;
+};
+
+static void *nsg6502_system_thread(void *data) {
+	struct nsg6502_system_thread *t = data;
+	struct nsg6502_system *s = t->system;
+	pthread_mutex_lock(&s->start);
+	pthread_mutex_unlock(&s->start);
+	while (!s->done) {
+		for (size_t i = t->index; i < s->count; i += s->threads) {
+			nsg6502_system_run_cpu(&s->cpus[i], s->time);
+		}
+		if (pthread_barrier_wait(&s->barrier) ==
+			PTHREAD_BARRIER_SERIAL_THREAD) {
+			nsg6502_system_commit(s);
+		}
+		pthread_barrier_wait(&s->barrier);
+	}
+	return NULL;
+}
+
+// cpus holds count CPUs with their memory set, which stay the host's. Their
+// callbacks are taken over, set read and write in nsg6502_system_cpu for
+// private devices. No memory is shared to begin with.
+static void nsg6502_system_init(struct nsg6502_system *s,
+								struct nsg6502_system_cpu *cpus, size_t count) {
+	memset(s, 0, sizeof(*s));
+	s->cpus = cpus;
+	s->count = count;
+	s->quantum = 10000;
+	s->shared_quantum = 32;
+	for (size_t i = 0; i < count; i++) {
+		cpus[i].system = s;
+		cpus[i].index = i;
+		cpus[i].log_count = 0;
+		cpus[i].shared_access = 0;
+		cpus[i].cpu.memory_read_callback = nsg6502_system_read;
+		cpus[i].cpu.memory_write_callback = nsg6502_system_write;
+	}
+}
+
+// Shares the pages covering [start, start + size), initialised from the
+// first CPU's memory
+static void nsg6502_system_share(struct nsg6502_system *s, uint16_t start,
+								 uint32_t size) {
+	for (uint32_t page = start >> 8; page <= (start + size - 1) >> 8 && size;
+		 page++) {
+		s->shared_page[page & 0xFF] = 1;
+		memcpy(&s->shared[(page & 0xFF) << 8],
+			   &s->cpus[0].cpu.memory[(page & 0xFF) << 8], 0x100);
+	}
+}
+
+// Writing addr, which has to be shared, raises irq on CPU cpu. Returns -1
+// when there are too many mailboxes.
+static int nsg6502_system_mailbox(struct nsg6502_system *s, uint16_t addr,
+								  size_t cpu, uint8_t irq) {
+	if (s->mailbox_count == NSG6502_SYSTEM_MAX_MAILBOXES) {
+		return -1;
+	}
+	s->mailboxes[s->mailbox_count++] =
+		(struct nsg6502_system_mailbox){addr, cpu, irq};
+	return 0;
+}
+
+// Runs every CPU for ticks more ticks on threads threads. The calling
+// thread is thread 0.
+static void nsg6502_system_run(struct nsg6502_system *s, size_t ticks,
+							   size_t threads) {
+	if (threads > s->count) {
+		threads = s->count;
+	}
+	if (threads > NSG6502_SYSTEM_MAX_THREADS) {
+		threads = NSG6502_SYSTEM_MAX_THREADS;
+	}
+	s->threads = threads ? threads : 1;
+	s->end = s->time + ticks;
+	s->done = 0;
+	nsg6502_system_next(s);
+
+	pthread_t handles[NSG6502_SYSTEM_MAX_THREADS];
+	struct nsg6502_system_thread args[NSG6502_SYSTEM_MAX_THREADS];
+	for (size_t i = 0; i < s->threads; i++) {
+		args[i] = (struct nsg6502_system_thread){s, i};
+	}
+	// The threads that were started wait until the barrier is set up for
+	// exactly them. Results do not depend on how many there are, so if
+	// creating one fails the run simply goes on with fewer.
+	pthread_mutex_init(&s->start, NULL);
+	pthread_mutex_lock(&s->start);
+	size_t started = 1;
+	while (started < s->threads &&
+		   pthread_create(&handles[started], NULL, nsg6502_system_thread,
+						  &args[started]) == 0) {
+		started++;
+	}
+	s->threads = started;
+	pthread_barrier_init(&s->barrier, NULL, s->threads);
+	pthread_mutex_unlock(&s->start);
+
+	nsg6502_system_thread(&args[0]);
+	for (size_t i = 1; i < s->threads; i++) {
+		pthread_join(handles[i], NULL);
+	}
+	pthread_barrier_destroy(&s->barrier);
+	pthread_mutex_destroy(&s->start);
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2024 - &__DATE__[7] NSG650
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Wozmon, assembled from wozmon.s for $FF00. Input comes from $0201 once
+// $0202 reads 1, output goes to $0200.
+
+#ifndef WOZMON_H
+#define WOZMON_H
+
+static const unsigned char wozmon[] = {
+	0xd8, 0x58, 0xa9, 0x1b, 0xc9, 0x08, 0xf0, 0x13, 0xc9, 0x1b, 0xf0, 0x03,
+	0xc8, 0x10, 0x0f, 0xa9, 0x5c, 0x20, 0xe7, 0xff, 0xa9, 0x0d, 0x20, 0xe7,
+	0xff, 0xa0, 0x01, 0x88, 0x30, 0xf6, 0xad, 0x02, 0x02, 0xc9, 0x01, 0xd0,
+	0xf9, 0xad, 0x01, 0x02, 0x99, 0x00, 0x03, 0x20, 0xe7, 0xff, 0xc9, 0x0d,
+	0xd0, 0xd2, 0xa0, 0xff, 0xa9, 0x00, 0xaa, 0x0a, 0x0a, 0x85, 0x2b, 0xc8,
+	0xb9, 0x00, 0x03, 0xc9, 0x0d, 0xf0, 0xd1, 0xc9, 0x2e, 0x90, 0xf4, 0xf0,
+	0xee, 0xc9, 0x3a, 0xf0, 0xeb, 0xc9, 0x52, 0xf0, 0x3b, 0x86, 0x28, 0x86,
+	0x29, 0x84, 0x2a, 0xb9, 0x00, 0x03, 0x49, 0x30, 0xc9, 0x0a, 0x90, 0x06,
+	0x69, 0x88, 0xc9, 0xfa, 0x90, 0x11, 0x0a, 0x0a, 0x0a, 0x0a, 0xa2, 0x04,
+	0x0a, 0x26, 0x28, 0x26, 0x29, 0xca, 0xd0, 0xf8, 0xc8, 0xd0, 0xe0, 0xc4,
+	0x2a, 0xf0, 0x94, 0x24, 0x2b, 0x50, 0x10, 0xa5, 0x28, 0x81, 0x26, 0xe6,
+	0x26, 0xd0, 0xb5, 0xe6, 0x27, 0x4c, 0x3c, 0xff, 0x6c, 0x24, 0x00, 0x30,
+	0x2b, 0xa2, 0x02, 0xb5, 0x27, 0x95, 0x25, 0x95, 0x23, 0xca, 0xd0, 0xf7,
+	0xd0, 0x14, 0xa9, 0x0d, 0x20, 0xe7, 0xff, 0xa5, 0x25, 0x20, 0xd4, 0xff,
+	0xa5, 0x24, 0x20, 0xd4, 0xff, 0xa9, 0x3a, 0x20, 0xe7, 0xff, 0xa9, 0x20,
+	0x20, 0xe7, 0xff, 0xa1, 0x24, 0x20, 0xd4, 0xff, 0x86, 0x2b, 0xa5, 0x24,
+	0xc5, 0x28, 0xa5, 0x25, 0xe5, 0x29, 0xb0, 0xc1, 0xe6, 0x24, 0xd0, 0x02,
+	0xe6, 0x25, 0xa5, 0x24, 0x29, 0x07, 0x10, 0xc8, 0x48, 0x4a, 0x4a, 0x4a,
+	0x4a, 0x20, 0xdd, 0xff, 0x68, 0x29, 0x0f, 0x09, 0x30, 0xc9, 0x3a, 0x90,
+	0x02, 0x69, 0x06, 0x8d, 0x00, 0x02, 0x60};
+static const unsigned int wozmon_len = sizeof(wozmon);
+
+#endif